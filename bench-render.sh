@@ -0,0 +1,39 @@
+#!/bin/sh
+
+# Time the renderers on the same headless run: GLES2 with and without the
+# tilemap chunk textures, GLES2 with early-Z, desktop GL 3.3 with instancing,
+# and the software renderer. Then GLES2 at a few window sizes, drawing at the
+# window's resolution or at 640x480 and scaling up, and GL 3.3 at each.
+# usage: ./bench-render.sh [frames]
+
+frames=${1:-600};
+if ! [ -x ./stl_player ]; then
+	./build.sh || exit $?;
+fi
+run() {
+	env "$@" ./stl_player --headless "$frames" 2>&1 |
+		grep '^HEADLESS\|per frame' | tail -3;
+}
+echo "GLES2, tilemap chunks:";
+run STL_PLAYER_RENDERER=gl;
+echo "GLES2, tilemap buffers only:";
+run STL_PLAYER_NO_TM_CHUNKS=1;
+echo "GLES2, early-Z:";
+run STL_PLAYER_EARLY_Z=1;
+echo "GL 3.3, instanced:";
+run STL_PLAYER_RENDERER=gl33;
+for threads in $(printf "1\n%s\n" "$(nproc)" | uniq); do
+	echo "software, $threads thread(s):";
+	run STL_PLAYER_RENDERER=soft STL_PLAYER_SOFT_THREADS=$threads;
+done
+for size in 640x480 1280x960 1920x1080 3840x2160; do
+	echo "GLES2 at $size:";
+	STL_PLAYER_HEADLESS_SIZE=$size ./stl_player --headless "$frames" 2>&1 |
+		grep 'ms/frame';
+	STL_PLAYER_HEADLESS_SIZE=$size STL_PLAYER_INTERNAL_SCALE=1 \
+		./stl_player --headless "$frames" 2>&1 | grep 'ms/frame';
+	echo "GL 3.3 at $size:";
+	STL_PLAYER_HEADLESS_SIZE=$size STL_PLAYER_RENDERER=gl33 \
+		./stl_player --headless "$frames" 2>&1 | grep 'ms/frame';
+done
+exit 0;
@@ -2,7 +2,7 @@
 
 clear;
 rm -f stlplayer;
-gcc -Wall -Wextra -Wno-switch -std=c11 -g -O0 -D USE_GLES2=1 \
-	initgl.c levelreader.c stlplayer.c util.c -o stl_player \
+gcc -Wall -Wextra -Wno-switch -std=c11 -g -O0 -D USE_GLES2=1 -D USE_IO_URING=1 \
+	gl33render.c gltrace.c initgl.c levelreader.c softrender.c stlplayer.c texloader.c util.c -o stl_player \
 	-lEGL -lX11 -lGLESv2 -lm -lpthread "$@";
 exit $?;
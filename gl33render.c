@@ -0,0 +1,390 @@
+// gl33render.c
+
+// Desktop GL 3.3 core-profile drawing, for STL_PLAYER_RENDERER=gl33. It is
+// handed the batcher's quads like softrender.c, but draws them on the GPU as
+// instances of one unit quad. Every 64x64 texture is a layer of one array
+// texture, so a frame's tiles and sprites go out in a single
+// glDrawArraysInstanced(), plus one for each run of quads using a texture of
+// another size (the background, the font atlas).
+
+#include "stlplayer.h"
+
+#include <GL/glcorearb.h>
+#include <stddef.h>
+
+enum {
+	GL33_TILE = 64,  // textures this size are layers of gGL33.tiles
+	GL33_CORNER = 0, GL33_RECT = 1, GL33_TEXRECT = 2, GL33_LAYER = 3,  // attribs
+};
+
+// The GL 3.3 entry points, loaded through EGL. (GLES2's headers already declare
+// the gl* names.)
+#define GL33_FUNCS(X) \
+	X(PFNGLACTIVETEXTUREPROC, ActiveTexture) \
+	X(PFNGLATTACHSHADERPROC, AttachShader) \
+	X(PFNGLBINDBUFFERPROC, BindBuffer) \
+	X(PFNGLBINDTEXTUREPROC, BindTexture) \
+	X(PFNGLBINDVERTEXARRAYPROC, BindVertexArray) \
+	X(PFNGLBLENDFUNCPROC, BlendFunc) \
+	X(PFNGLBUFFERDATAPROC, BufferData) \
+	X(PFNGLCLEARPROC, Clear) \
+	X(PFNGLCLEARCOLORPROC, ClearColor) \
+	X(PFNGLCOMPILESHADERPROC, CompileShader) \
+	X(PFNGLCREATEPROGRAMPROC, CreateProgram) \
+	X(PFNGLCREATESHADERPROC, CreateShader) \
+	X(PFNGLDELETEBUFFERSPROC, DeleteBuffers) \
+	X(PFNGLDELETEPROGRAMPROC, DeleteProgram) \
+	X(PFNGLDELETESHADERPROC, DeleteShader) \
+	X(PFNGLDELETETEXTURESPROC, DeleteTextures) \
+	X(PFNGLDELETEVERTEXARRAYSPROC, DeleteVertexArrays) \
+	X(PFNGLDRAWARRAYSINSTANCEDPROC, DrawArraysInstanced) \
+	X(PFNGLENABLEPROC, Enable) \
+	X(PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray) \
+	X(PFNGLGENBUFFERSPROC, GenBuffers) \
+	X(PFNGLGENTEXTURESPROC, GenTextures) \
+	X(PFNGLGENVERTEXARRAYSPROC, GenVertexArrays) \
+	X(PFNGLGETERRORPROC, GetError) \
+	X(PFNGLGETINTEGERVPROC, GetIntegerv) \
+	X(PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog) \
+	X(PFNGLGETPROGRAMIVPROC, GetProgramiv) \
+	X(PFNGLGETSHADERINFOLOGPROC, GetShaderInfoLog) \
+	X(PFNGLGETSHADERIVPROC, GetShaderiv) \
+	X(PFNGLGETSTRINGPROC, GetString) \
+	X(PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation) \
+	X(PFNGLLINKPROGRAMPROC, LinkProgram) \
+	X(PFNGLSHADERSOURCEPROC, ShaderSource) \
+	X(PFNGLTEXIMAGE2DPROC, TexImage2D) \
+	X(PFNGLTEXIMAGE3DPROC, TexImage3D) \
+	X(PFNGLTEXPARAMETERIPROC, TexParameteri) \
+	X(PFNGLTEXSUBIMAGE3DPROC, TexSubImage3D) \
+	X(PFNGLUNIFORM1IPROC, Uniform1i) \
+	X(PFNGLUSEPROGRAMPROC, UseProgram) \
+	X(PFNGLVERTEXATTRIBDIVISORPROC, VertexAttribDivisor) \
+	X(PFNGLVERTEXATTRIBPOINTERPROC, VertexAttribPointer) \
+	X(PFNGLVIEWPORTPROC, Viewport)
+
+static struct {
+#define X(type, name) type name;
+	GL33_FUNCS(X)
+#undef X
+} gl;
+
+// One quad's instance attributes, as shaders/instanced-vtx.txt takes them.
+struct gl33Quad {
+	float rect[4];  // top left x, y; width; height (negative: y goes up)
+	float texRect[4];  // s, t at the top left; at the bottom right
+	float layer;  // in gGL33.tiles, or -1 for the quad's own image
+};
+
+struct gl33Texture {
+	int layer;  // in gGL33.tiles, or -1
+	GLuint image;  // its own texture, if it is not GL33_TILE x GL33_TILE
+	uint8_t *texels;  // the layer's, RGBA, to fill gGL33.tiles again
+	bool dirty;  // texels not in gGL33.tiles yet
+};
+
+static struct {
+	int viewport[4];
+	uint32_t clearColor;
+
+	struct gl33Texture *textures;  // indexed by texnam; 0 is never used
+	size_t nTextures;
+	GLuint tiles;  // GL_TEXTURE_2D_ARRAY on texture unit 0
+	int nLayers, capLayers, maxLayers;
+	bool tilesDirty;
+
+	GLuint program, vao, cornerVbo, quadVbo;
+	struct gl33Quad *quads;
+	GLuint *images;  // each queued quad's image texture, or 0
+	size_t nQuads, capQuads;
+} gGL33;
+
+// Pick the desktop GL renderer with STL_PLAYER_RENDERER=gl33.
+bool usingGL33Renderer(void) {
+	static int gl33 = -1;
+	if (gl33 == -1) {
+		const char *const renderer = getenv("STL_PLAYER_RENDERER");
+		gl33 = renderer && 0 == strcmp(renderer, "gl33");
+	}
+	return gl33;
+}
+
+static GLuint compileShader(const GLenum type, const char *const path) {
+	ssize_t len;
+	char *const src = vfsRead(path, &len);
+	must(src != NULL);
+	src[len] = '\0';  // safe_read() leaves room
+	const GLuint shdr = gl.CreateShader(type);
+	gl.ShaderSource(shdr, 1, (const GLchar *const *)&src, NULL);
+	gl.CompileShader(shdr);
+	free(src);
+	GLint ok = GL_FALSE;
+	gl.GetShaderiv(shdr, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		gl.GetShaderInfoLog(shdr, sizeof(log), NULL, log);
+		fprintf(stderr, "DEBUG: %s: %s\n", path, log);
+	}
+	must(ok);
+	return shdr;
+}
+
+static void initialize_program(void) {
+	const GLuint vtx = compileShader(GL_VERTEX_SHADER,
+		"shaders/instanced-vtx.txt");
+	const GLuint frag = compileShader(GL_FRAGMENT_SHADER,
+		"shaders/instanced-frag.txt");
+	gGL33.program = gl.CreateProgram();
+	gl.AttachShader(gGL33.program, vtx);
+	gl.AttachShader(gGL33.program, frag);
+	gl.LinkProgram(gGL33.program);
+	gl.DeleteShader(vtx);  // (only flagged; the program keeps them)
+	gl.DeleteShader(frag);
+	GLint ok = GL_FALSE;
+	gl.GetProgramiv(gGL33.program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		gl.GetProgramInfoLog(gGL33.program, sizeof(log), NULL, log);
+		fprintf(stderr, "DEBUG: instanced program: %s\n", log);
+	}
+	must(ok);
+	gl.UseProgram(gGL33.program);
+	gl.Uniform1i(gl.GetUniformLocation(gGL33.program, "tiles"), 0);
+	gl.Uniform1i(gl.GetUniformLocation(gGL33.program, "image"), 1);
+}
+
+// The unit quad, and the instance attributes read from gGL33.quadVbo.
+static void initialize_vao(void) {
+	gl.GenVertexArrays(1, &gGL33.vao);
+	gl.BindVertexArray(gGL33.vao);
+	static const float corners[] = {  // in the batcher's order
+		0, 0,  0, 1,  1, 0,  1, 1,
+	};
+	gl.GenBuffers(1, &gGL33.cornerVbo);
+	gl.BindBuffer(GL_ARRAY_BUFFER, gGL33.cornerVbo);
+	gl.BufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	gl.VertexAttribPointer(GL33_CORNER, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	gl.EnableVertexAttribArray(GL33_CORNER);
+	gl.GenBuffers(1, &gGL33.quadVbo);
+	gl.BindBuffer(GL_ARRAY_BUFFER, gGL33.quadVbo);
+	for (GLuint a = GL33_RECT; a <= GL33_LAYER; a++) {
+		gl.EnableVertexAttribArray(a);
+		gl.VertexAttribDivisor(a, 1);
+	}
+}
+
+static void setTexParameters(const GLenum target, const GLint filter) {
+	gl.TexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+	gl.TexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+	gl.TexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	gl.TexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static void gl33Init(void) {
+#define X(type, name) \
+	must(NULL != (gl.name = (type)eglGetProcAddress("gl" #name)));
+	GL33_FUNCS(X)
+#undef X
+	fprintf(stderr, "DEBUG: desktop GL renderer, GL %s\n",
+		(const char *)gl.GetString(GL_VERSION));
+	initialize_program();
+	initialize_vao();
+
+	gl.GetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &gGL33.maxLayers);
+	gl.GenTextures(1, &gGL33.tiles);
+	gl.ActiveTexture(GL_TEXTURE0);
+	gl.BindTexture(GL_TEXTURE_2D_ARRAY, gGL33.tiles);
+	setTexParameters(GL_TEXTURE_2D_ARRAY, GL_NEAREST);
+	gl.ActiveTexture(GL_TEXTURE1);  // for the images, from here on
+
+	gl.Enable(GL_BLEND);
+	gl.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl.GetIntegerv(GL_VIEWPORT, gGL33.viewport);
+	gGL33.clearColor = 0xff000000;
+}
+
+static void gl33Terminate(void) {
+	for (size_t i = 0; i < gGL33.nTextures; i++) {
+		free(gGL33.textures[i].texels);
+		if (gGL33.textures[i].image)
+			gl.DeleteTextures(1, &gGL33.textures[i].image);
+	}
+	free(gGL33.textures);
+	free(gGL33.quads);
+	free(gGL33.images);
+	gl.DeleteTextures(1, &gGL33.tiles);
+	gl.DeleteBuffers(1, &gGL33.cornerVbo);
+	gl.DeleteBuffers(1, &gGL33.quadVbo);
+	gl.DeleteVertexArrays(1, &gGL33.vao);
+	gl.DeleteProgram(gGL33.program);
+}
+
+static uint32_t gl33GenTexture(void) {
+	gGL33.textures = nnrealloc(gGL33.textures,
+		(gGL33.nTextures + 2) * sizeof(struct gl33Texture));
+	if (gGL33.nTextures == 0)
+		gGL33.textures[gGL33.nTextures++] = (struct gl33Texture){ .layer = -1 };
+	gGL33.textures[gGL33.nTextures] = (struct gl33Texture){ .layer = -1 };
+	return gGL33.nTextures++;
+}
+
+static void gl33TexImage(const uint32_t texnam, const int width,
+	const int height, const char *const texels, const bool hasAlpha) {
+	must(texnam > 0 && texnam < gGL33.nTextures);
+	struct gl33Texture *const tex = &gGL33.textures[texnam];
+	uint8_t *const rgba = nnmalloc((size_t)width * height * 4);
+	const uint8_t *src = (const uint8_t *)texels;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		memcpy(&rgba[i * 4], src, 3);
+		rgba[i * 4 + 3] = hasAlpha ? src[3] : 0xff;
+		src += hasAlpha ? 4 : 3;
+	}
+	free(tex->texels);
+	tex->texels = NULL;
+
+	if (width == GL33_TILE && height == GL33_TILE) {
+		if (tex->layer < 0)
+			tex->layer = gGL33.nLayers++;
+		tex->texels = rgba;
+		tex->dirty = gGL33.tilesDirty = true;
+		return;
+	}
+	tex->layer = -1;
+	if (!tex->image) {
+		gl.GenTextures(1, &tex->image);
+		gl.BindTexture(GL_TEXTURE_2D, tex->image);
+		// a level background is smoothed when scaled up, as in the GLES2 path
+		setTexParameters(GL_TEXTURE_2D, width == 640 && height == 480 ?
+			GL_LINEAR : GL_NEAREST);
+	} else
+		gl.BindTexture(GL_TEXTURE_2D, tex->image);
+	gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, rgba);
+	free(rgba);
+}
+
+// Copy the new 64x64 textures into gGL33.tiles, growing it if need be.
+static void uploadTiles(void) {
+	gl.ActiveTexture(GL_TEXTURE0);
+	if (gGL33.nLayers > gGL33.capLayers) {
+		gGL33.capLayers = gGL33.capLayers ? gGL33.capLayers * 2 : 256;
+		if (gGL33.capLayers < gGL33.nLayers)
+			gGL33.capLayers = gGL33.nLayers;
+		if (gGL33.capLayers > gGL33.maxLayers)
+			gGL33.capLayers = gGL33.maxLayers;
+		must(gGL33.nLayers <= gGL33.capLayers);
+		gl.TexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, GL33_TILE, GL33_TILE,
+			gGL33.capLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		for (size_t i = 0; i < gGL33.nTextures; i++)
+			gGL33.textures[i].dirty = gGL33.textures[i].layer >= 0;
+	}
+	for (size_t i = 0; i < gGL33.nTextures; i++) {
+		struct gl33Texture *const tex = &gGL33.textures[i];
+		if (!tex->dirty)
+			continue;
+		gl.TexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tex->layer, GL33_TILE,
+			GL33_TILE, 1, GL_RGBA, GL_UNSIGNED_BYTE, tex->texels);
+		tex->dirty = false;
+	}
+	gl.ActiveTexture(GL_TEXTURE1);
+	gGL33.tilesDirty = false;
+}
+
+static void gl33Viewport(const int x, const int y, const int width,
+	const int height) {
+	gGL33.viewport[0] = x;
+	gGL33.viewport[1] = y;
+	gGL33.viewport[2] = width;
+	gGL33.viewport[3] = height;
+}
+
+static void gl33Clear(const uint32_t color) {
+	gGL33.clearColor = color;
+	gGL33.nQuads = 0;
+}
+
+static void gl33QueueQuads(const float *const verts,
+	const uint32_t *const texnams, const size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		const float *const v = &verts[i * 16];
+		if (texnams[i] == 0 || texnams[i] >= gGL33.nTextures)
+			continue;
+		const struct gl33Texture *const tex = &gGL33.textures[texnams[i]];
+		if (tex->layer < 0 && !tex->image)
+			continue;  // nothing uploaded
+
+		if (gGL33.nQuads == gGL33.capQuads) {
+			gGL33.capQuads = gGL33.capQuads ? gGL33.capQuads * 2 : 1024;
+			gGL33.quads = nnrealloc(gGL33.quads,
+				gGL33.capQuads * sizeof(struct gl33Quad));
+			gGL33.images = nnrealloc(gGL33.images,
+				gGL33.capQuads * sizeof(GLuint));
+		}
+		gGL33.quads[gGL33.nQuads] = (struct gl33Quad){
+			.rect = { v[0], v[1], v[8] - v[0], v[5] - v[1] },
+			.texRect = { v[2], v[3], v[10], v[7] },
+			.layer = tex->layer,
+		};
+		gGL33.images[gGL33.nQuads++] = tex->layer < 0 ? tex->image : 0;
+	}
+}
+
+// Point the instance attributes at the quads from first on. (GL 3.3 has no
+// base instance for glDrawArraysInstanced().)
+static void pointAtQuads(const size_t first) {
+	const char *const base = (const char *)(first * sizeof(struct gl33Quad));
+	gl.VertexAttribPointer(GL33_RECT, 4, GL_FLOAT, GL_FALSE,
+		sizeof(struct gl33Quad), base + offsetof(struct gl33Quad, rect));
+	gl.VertexAttribPointer(GL33_TEXRECT, 4, GL_FLOAT, GL_FALSE,
+		sizeof(struct gl33Quad), base + offsetof(struct gl33Quad, texRect));
+	gl.VertexAttribPointer(GL33_LAYER, 1, GL_FLOAT, GL_FALSE,
+		sizeof(struct gl33Quad), base + offsetof(struct gl33Quad, layer));
+}
+
+// Draw everything queued since gl33Clear(): one instanced draw per run of
+// quads that needs no more than one image texture.
+static int gl33FinishFrame(void) {
+	if (gGL33.tilesDirty)
+		uploadTiles();
+	gl.Viewport(gGL33.viewport[0], gGL33.viewport[1], gGL33.viewport[2],
+		gGL33.viewport[3]);
+	const uint32_t c = gGL33.clearColor;
+	gl.ClearColor((c >> 16 & 0xff) / 255.0f, (c >> 8 & 0xff) / 255.0f,
+		(c & 0xff) / 255.0f, (c >> 24) / 255.0f);
+	gl.Clear(GL_COLOR_BUFFER_BIT);
+	if (gGL33.nQuads == 0)
+		return 0;
+
+	gl.BufferData(GL_ARRAY_BUFFER, gGL33.nQuads * sizeof(struct gl33Quad),
+		gGL33.quads, GL_STREAM_DRAW);
+	int drawCalls = 0;
+	for (size_t first = 0, end = 0; first < gGL33.nQuads; first = end) {
+		GLuint image = 0;
+		for (; end < gGL33.nQuads; end++) {
+			if (gGL33.images[end] == 0)
+				continue;
+			if (image && gGL33.images[end] != image)
+				break;
+			image = gGL33.images[end];
+		}
+		if (image)
+			gl.BindTexture(GL_TEXTURE_2D, image);
+		pointAtQuads(first);
+		gl.DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, end - first);
+		drawCalls++;
+	}
+	gGL33.nQuads = 0;
+	assert(gl.GetError() == GL_NO_ERROR);
+	return drawCalls;
+}
+
+const struct quadRenderer gGL33Renderer = {
+	.init = gl33Init,
+	.terminate = gl33Terminate,
+	.genTexture = gl33GenTexture,
+	.texImage = gl33TexImage,
+	.viewport = gl33Viewport,
+	.clear = gl33Clear,
+	.queueQuads = gl33QueueQuads,
+	.finishFrame = gl33FinishFrame,
+};
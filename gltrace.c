@@ -0,0 +1,790 @@
+// gltrace.c
+#define GLTRACE_C
+
+// Records the GL calls stlplayer.c makes (STL_PLAYER_TRACE=path) into a
+// compact binary trace, and replays one against a headless context with none
+// of the game running, timing each frame. Objects are recorded under the names
+// the GL gave them, and the replay maps those to the names it gets.
+
+#include "stlplayer.h"
+#include "gltrace.h"
+
+#include <stdarg.h>
+
+static const char kTraceMagic[8] = "STLTRC01";
+
+// A record is its op (one byte), then its arguments as 32-bit words, then (for
+// the ones with data) a 32-bit length and that many bytes.
+enum traceOp {
+	OP_FRAME,  // the end of a frame
+	OP_PROGRAM,  // name; then the attrib 0 name, vertex and fragment sources
+	OP_ACTIVE_TEXTURE, OP_BIND_TEXTURE, OP_USE_PROGRAM, OP_BIND_FRAMEBUFFER,
+	OP_BIND_BUFFER, OP_BIND_RENDERBUFFER, OP_BUFFER_DATA, OP_BUFFER_SUB_DATA,
+	OP_VERTEX_ATTRIB_POINTER, OP_ENABLE_VERTEX_ATTRIB_ARRAY, OP_ENABLE,
+	OP_DISABLE, OP_BLEND_FUNC, OP_BLEND_FUNC_SEPARATE, OP_DEPTH_MASK,
+	OP_DEPTH_FUNC, OP_DEPTH_RANGEF, OP_GET_UNIFORM_LOCATION, OP_UNIFORM2F,
+	OP_VIEWPORT, OP_DRAW_ELEMENTS, OP_CLEAR, OP_CLEAR_COLOR, OP_TEX_IMAGE_2D,
+	OP_TEX_PARAMETERI, OP_TEX_PARAMETERF, OP_GEN_TEXTURES, OP_DELETE_TEXTURES,
+	OP_GEN_BUFFERS, OP_GEN_FRAMEBUFFERS, OP_GEN_RENDERBUFFERS,
+	OP_RENDERBUFFER_STORAGE, OP_FRAMEBUFFER_TEXTURE_2D,
+	OP_FRAMEBUFFER_RENDERBUFFER,
+};
+
+static struct {
+	FILE *f;  // NULL unless tracing
+	const char *path;
+	int frames, maxFrames;
+	uint64_t bytes;
+} gTrace;
+
+static void put(const void *const data, const size_t len) {
+	must(fwrite(data, 1, len, gTrace.f) == len);
+	gTrace.bytes += len;
+}
+
+// Record op with n 32-bit arguments.
+static void putOp(const enum traceOp op, const int n, ...) {
+	const uint8_t byte = op;
+	put(&byte, 1);
+	va_list ap;
+	va_start(ap, n);
+	for (int i = 0; i < n; i++) {
+		const uint32_t word = va_arg(ap, uint32_t);
+		put(&word, sizeof(word));
+	}
+	va_end(ap);
+}
+
+static void putData(const void *const data, const size_t len) {
+	const uint32_t word = len;
+	put(&word, sizeof(word));
+	put(data, len);
+}
+
+static uint32_t floatBits(const float f) {
+	uint32_t word;
+	memcpy(&word, &f, sizeof(word));
+	return word;
+}
+
+// Start tracing if STL_PLAYER_TRACE names a file. It stops after
+// STL_PLAYER_TRACE_FRAMES (default 600) frames.
+void traceStart(void) {
+	gTrace.path = getenv("STL_PLAYER_TRACE");
+	if (!gTrace.path)
+		return;
+	const char *const frames = getenv("STL_PLAYER_TRACE_FRAMES");
+	gTrace.maxFrames = frames ? atoi(frames) : 600;
+	gTrace.f = fopen(gTrace.path, "wb");
+	if (!gTrace.f) {
+		fprintf(stderr, "WARN: could not open trace %s\n", gTrace.path);
+		return;
+	}
+	setvbuf(gTrace.f, NULL, _IOFBF, 1 << 20);
+	put(kTraceMagic, sizeof(kTraceMagic));
+	fprintf(stderr, "DEBUG: tracing %d frames of GL calls to %s\n",
+		gTrace.maxFrames, gTrace.path);
+}
+
+// Whether GL calls are being recorded.
+bool tracing(void) {
+	return gTrace.f != NULL;
+}
+
+// Mark the end of a frame.
+void traceFrame(void) {
+	if (!gTrace.f)
+		return;
+	putOp(OP_FRAME, 0);
+	if (++gTrace.frames < gTrace.maxFrames)
+		return;
+	must(0 == fclose(gTrace.f));
+	gTrace.f = NULL;
+	fprintf(stderr, "DEBUG: traced %d frames (%.1f MB) to %s\n", gTrace.frames,
+		gTrace.bytes / 1e6, gTrace.path);
+}
+
+// Record a program, which the replay compiles and links from the sources
+// (stlplayer.c may have loaded it from the program cache instead).
+void traceProgram(const uint32_t program, const char *const attrib0,
+	const char *const vtx_src, const char *const frag_src) {
+	if (!gTrace.f)
+		return;
+	putOp(OP_PROGRAM, 1, program);
+	putData(attrib0, strlen(attrib0) + 1);
+	putData(vtx_src, strlen(vtx_src) + 1);
+	putData(frag_src, strlen(frag_src) + 1);
+}
+
+// Bytes per texel of a glTexImage2D() format and type.
+static size_t texelBytes(const GLenum format, const GLenum type) {
+	if (type != GL_UNSIGNED_BYTE)  // the 16-bit packed types
+		return 2;
+	switch (format) {
+	case GL_RGBA: return 4;
+	case GL_RGB: return 3;
+	case GL_LUMINANCE_ALPHA: return 2;
+	default: return 1;
+	}
+}
+
+// The bytes glTexImage2D() reads from its pixels. Rows are 4-byte aligned
+// (GL_UNPACK_ALIGNMENT), except for the last.
+static size_t imageBytes(const GLsizei width, const GLsizei height,
+	const GLenum format, const GLenum type) {
+	if (width <= 0 || height <= 0)
+		return 0;
+	const size_t row = (size_t)width * texelBytes(format, type);
+	return ((row + 3) & ~(size_t)3) * (height - 1) + row;
+}
+
+void trActiveTexture(const GLenum texture) {
+	glActiveTexture(texture);
+	if (gTrace.f)
+		putOp(OP_ACTIVE_TEXTURE, 1, texture);
+}
+
+void trBindTexture(const GLenum target, const GLuint texture) {
+	glBindTexture(target, texture);
+	if (gTrace.f)
+		putOp(OP_BIND_TEXTURE, 2, target, texture);
+}
+
+void trUseProgram(const GLuint program) {
+	glUseProgram(program);
+	if (gTrace.f)
+		putOp(OP_USE_PROGRAM, 1, program);
+}
+
+void trBindFramebuffer(const GLenum target, const GLuint framebuffer) {
+	glBindFramebuffer(target, framebuffer);
+	if (gTrace.f)
+		putOp(OP_BIND_FRAMEBUFFER, 2, target, framebuffer);
+}
+
+void trBindBuffer(const GLenum target, const GLuint buffer) {
+	glBindBuffer(target, buffer);
+	if (gTrace.f)
+		putOp(OP_BIND_BUFFER, 2, target, buffer);
+}
+
+void trBindRenderbuffer(const GLenum target, const GLuint renderbuffer) {
+	glBindRenderbuffer(target, renderbuffer);
+	if (gTrace.f)
+		putOp(OP_BIND_RENDERBUFFER, 2, target, renderbuffer);
+}
+
+void trBufferData(const GLenum target, const GLsizeiptr size,
+	const void *const data, const GLenum usage) {
+	glBufferData(target, size, data, usage);
+	if (!gTrace.f)
+		return;
+	putOp(OP_BUFFER_DATA, 3, target, usage, (uint32_t)size);
+	putData(data, data ? size : 0);
+}
+
+void trBufferSubData(const GLenum target, const GLintptr offset,
+	const GLsizeiptr size, const void *const data) {
+	glBufferSubData(target, offset, size, data);
+	if (!gTrace.f)
+		return;
+	putOp(OP_BUFFER_SUB_DATA, 2, target, (uint32_t)offset);
+	putData(data, size);
+}
+
+// pointer is always an offset into the bound buffer.
+void trVertexAttribPointer(const GLuint index, const GLint size,
+	const GLenum type, const GLboolean normalized, const GLsizei stride,
+	const void *const pointer) {
+	glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+	if (gTrace.f)
+		putOp(OP_VERTEX_ATTRIB_POINTER, 6, index, (uint32_t)size, type,
+			(uint32_t)normalized, (uint32_t)stride, (uint32_t)(size_t)pointer);
+}
+
+void trEnableVertexAttribArray(const GLuint index) {
+	glEnableVertexAttribArray(index);
+	if (gTrace.f)
+		putOp(OP_ENABLE_VERTEX_ATTRIB_ARRAY, 1, index);
+}
+
+// Whether enabling or disabling cap changes what is drawn. GL_KHR_debug's
+// output is for debug builds, so it is left out of traces.
+static bool drawsWith(const GLenum cap) {
+	return cap != GL_DEBUG_OUTPUT_KHR && cap != GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR;
+}
+
+void trEnable(const GLenum cap) {
+	glEnable(cap);
+	if (gTrace.f && drawsWith(cap))
+		putOp(OP_ENABLE, 1, cap);
+}
+
+void trDisable(const GLenum cap) {
+	glDisable(cap);
+	if (gTrace.f && drawsWith(cap))
+		putOp(OP_DISABLE, 1, cap);
+}
+
+void trBlendFunc(const GLenum sfactor, const GLenum dfactor) {
+	glBlendFunc(sfactor, dfactor);
+	if (gTrace.f)
+		putOp(OP_BLEND_FUNC, 2, sfactor, dfactor);
+}
+
+void trBlendFuncSeparate(const GLenum srcRGB, const GLenum dstRGB,
+	const GLenum srcAlpha, const GLenum dstAlpha) {
+	glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+	if (gTrace.f)
+		putOp(OP_BLEND_FUNC_SEPARATE, 4, srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+void trDepthMask(const GLboolean flag) {
+	glDepthMask(flag);
+	if (gTrace.f)
+		putOp(OP_DEPTH_MASK, 1, (uint32_t)flag);
+}
+
+void trDepthFunc(const GLenum func) {
+	glDepthFunc(func);
+	if (gTrace.f)
+		putOp(OP_DEPTH_FUNC, 1, func);
+}
+
+void trDepthRangef(const GLfloat n, const GLfloat f) {
+	glDepthRangef(n, f);
+	if (gTrace.f)
+		putOp(OP_DEPTH_RANGEF, 2, floatBits(n), floatBits(f));
+}
+
+GLint trGetUniformLocation(const GLuint program, const GLchar *const name) {
+	const GLint location = glGetUniformLocation(program, name);
+	if (gTrace.f) {
+		putOp(OP_GET_UNIFORM_LOCATION, 2, program, (uint32_t)location);
+		putData(name, strlen(name) + 1);
+	}
+	return location;
+}
+
+void trUniform2f(const GLint location, const GLfloat v0, const GLfloat v1) {
+	glUniform2f(location, v0, v1);
+	if (gTrace.f)
+		putOp(OP_UNIFORM2F, 3, (uint32_t)location, floatBits(v0),
+			floatBits(v1));
+}
+
+void trViewport(const GLint x, const GLint y, const GLsizei width,
+	const GLsizei height) {
+	glViewport(x, y, width, height);
+	if (gTrace.f)
+		putOp(OP_VIEWPORT, 4, (uint32_t)x, (uint32_t)y, (uint32_t)width,
+			(uint32_t)height);
+}
+
+// indices is always an offset into the bound element buffer.
+void trDrawElements(const GLenum mode, const GLsizei count, const GLenum type,
+	const void *const indices) {
+	glDrawElements(mode, count, type, indices);
+	if (gTrace.f)
+		putOp(OP_DRAW_ELEMENTS, 4, mode, (uint32_t)count, type,
+			(uint32_t)(size_t)indices);
+}
+
+void trClear(const GLbitfield mask) {
+	glClear(mask);
+	if (gTrace.f)
+		putOp(OP_CLEAR, 1, mask);
+}
+
+void trClearColor(const GLfloat r, const GLfloat g, const GLfloat b,
+	const GLfloat a) {
+	glClearColor(r, g, b, a);
+	if (gTrace.f)
+		putOp(OP_CLEAR_COLOR, 4, floatBits(r), floatBits(g), floatBits(b),
+			floatBits(a));
+}
+
+void trTexImage2D(const GLenum target, const GLint level,
+	const GLint internalformat, const GLsizei width, const GLsizei height,
+	const GLint border, const GLenum format, const GLenum type,
+	const void *const pixels) {
+	glTexImage2D(target, level, internalformat, width, height, border, format,
+		type, pixels);
+	if (!gTrace.f)
+		return;
+	putOp(OP_TEX_IMAGE_2D, 8, target, (uint32_t)level,
+		(uint32_t)internalformat, (uint32_t)width, (uint32_t)height,
+		(uint32_t)border, format, type);
+	putData(pixels, pixels ? imageBytes(width, height, format, type) : 0);
+}
+
+void trTexParameteri(const GLenum target, const GLenum pname,
+	const GLint param) {
+	glTexParameteri(target, pname, param);
+	if (gTrace.f)
+		putOp(OP_TEX_PARAMETERI, 3, target, pname, (uint32_t)param);
+}
+
+void trTexParameterf(const GLenum target, const GLenum pname,
+	const GLfloat param) {
+	glTexParameterf(target, pname, param);
+	if (gTrace.f)
+		putOp(OP_TEX_PARAMETERF, 3, target, pname, floatBits(param));
+}
+
+// Helper for the glGen*() and glDelete*() recorders.
+static void putNames(const enum traceOp op, const GLsizei n,
+	const GLuint *const names) {
+	putOp(op, 0);
+	putData(names, n * sizeof(GLuint));
+}
+
+void trGenTextures(const GLsizei n, GLuint *const textures) {
+	glGenTextures(n, textures);
+	if (gTrace.f)
+		putNames(OP_GEN_TEXTURES, n, textures);
+}
+
+void trDeleteTextures(const GLsizei n, const GLuint *const textures) {
+	if (gTrace.f)
+		putNames(OP_DELETE_TEXTURES, n, textures);
+	glDeleteTextures(n, textures);
+}
+
+void trGenBuffers(const GLsizei n, GLuint *const buffers) {
+	glGenBuffers(n, buffers);
+	if (gTrace.f)
+		putNames(OP_GEN_BUFFERS, n, buffers);
+}
+
+void trGenFramebuffers(const GLsizei n, GLuint *const framebuffers) {
+	glGenFramebuffers(n, framebuffers);
+	if (gTrace.f)
+		putNames(OP_GEN_FRAMEBUFFERS, n, framebuffers);
+}
+
+void trGenRenderbuffers(const GLsizei n, GLuint *const renderbuffers) {
+	glGenRenderbuffers(n, renderbuffers);
+	if (gTrace.f)
+		putNames(OP_GEN_RENDERBUFFERS, n, renderbuffers);
+}
+
+void trRenderbufferStorage(const GLenum target, const GLenum internalformat,
+	const GLsizei width, const GLsizei height) {
+	glRenderbufferStorage(target, internalformat, width, height);
+	if (gTrace.f)
+		putOp(OP_RENDERBUFFER_STORAGE, 4, target, internalformat,
+			(uint32_t)width, (uint32_t)height);
+}
+
+void trFramebufferTexture2D(const GLenum target, const GLenum attachment,
+	const GLenum textarget, const GLuint texture, const GLint level) {
+	glFramebufferTexture2D(target, attachment, textarget, texture, level);
+	if (gTrace.f)
+		putOp(OP_FRAMEBUFFER_TEXTURE_2D, 5, target, attachment, textarget,
+			texture, (uint32_t)level);
+}
+
+void trFramebufferRenderbuffer(const GLenum target, const GLenum attachment,
+	const GLenum renderbuffertarget, const GLuint renderbuffer) {
+	glFramebufferRenderbuffer(target, attachment, renderbuffertarget,
+		renderbuffer);
+	if (gTrace.f)
+		putOp(OP_FRAMEBUFFER_RENDERBUFFER, 4, target, attachment,
+			renderbuffertarget, renderbuffer);
+}
+
+// The replay's names for the names in a trace, indexed by the trace's.
+struct nameMap {
+	GLuint *names;
+	size_t len;
+};
+
+static GLuint mapName(const struct nameMap *const map, const GLuint name) {
+	return name < map->len ? map->names[name] : 0;
+}
+
+static void setName(struct nameMap *const map, const GLuint name,
+	const GLuint replayName) {
+	if (name >= map->len) {
+		const size_t len = name + 256;
+		map->names = nnrealloc(map->names, len * sizeof(GLuint));
+		memset(map->names + map->len, 0, (len - map->len) * sizeof(GLuint));
+		map->len = len;
+	}
+	map->names[name] = replayName;
+}
+
+// A uniform location of a program in the trace, and the replay's.
+struct uniformMap {
+	GLuint program;
+	GLint location, replayLocation;
+};
+
+struct replay {
+	const uint8_t *p, *end;
+	struct nameMap textures, buffers, framebuffers, renderbuffers, programs;
+	struct uniformMap *uniforms;
+	size_t nUniforms;
+	GLuint program;  // the trace's name of the program in use
+	bool failed;
+};
+
+// Fail the replay on a record cut short by the end of the trace.
+static void truncated(struct replay *const r) {
+	if (!r->failed)
+		fprintf(stderr, "REPLAY: a record runs past the end of the trace\n");
+	r->failed = true;
+	r->p = r->end;
+}
+
+static uint32_t getWord(struct replay *const r) {
+	uint32_t word = 0;
+	if (r->end - r->p < (ptrdiff_t)sizeof(word)) {
+		truncated(r);
+		return 0;
+	}
+	memcpy(&word, r->p, sizeof(word));
+	r->p += sizeof(word);
+	return word;
+}
+
+static float getFloat(struct replay *const r) {
+	const uint32_t word = getWord(r);
+	float f;
+	memcpy(&f, &word, sizeof(f));
+	return f;
+}
+
+// The data of a record, or NULL if it has none (or runs past the trace).
+static const void *getData(struct replay *const r, uint32_t *const len) {
+	*len = getWord(r);
+	if (*len > (size_t)(r->end - r->p)) {
+		truncated(r);
+		*len = 0;
+	}
+	const void *const data = r->p;
+	r->p += *len;
+	return *len ? data : NULL;
+}
+
+// Fail the replay if a call's data is shorter than the need bytes it reads.
+static bool enoughData(struct replay *const r, const void *const data,
+	const uint32_t len, const size_t need, const char *const call) {
+	if (!data || len >= need)
+		return true;
+	fprintf(stderr, "REPLAY: %s has %u bytes of data but needs %zu\n", call,
+		len, need);
+	r->failed = true;
+	return false;
+}
+
+// Replay a glGen*() of names into map with gen.
+static void replayGen(struct replay *const r, struct nameMap *const map,
+	void (*gen)(GLsizei, GLuint *)) {
+	uint32_t len;
+	const GLuint *const names = getData(r, &len);
+	for (size_t i = 0; names && i < len / sizeof(GLuint); i++) {
+		GLuint name;
+		memcpy(&name, &names[i], sizeof(name));
+		GLuint replayName;
+		gen(1, &replayName);
+		setName(map, name, replayName);
+	}
+}
+
+// Compile and link a recorded program. Return 0 on failure.
+static GLuint replayProgram(const char *const attrib0,
+	const char *const vtx_src, const char *const frag_src) {
+	const GLuint program = glCreateProgram();
+	const GLuint vtx = glCreateShader(GL_VERTEX_SHADER);
+	const GLuint frag = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(vtx, 1, &vtx_src, NULL);
+	glShaderSource(frag, 1, &frag_src, NULL);
+	glCompileShader(vtx);
+	glCompileShader(frag);
+	glAttachShader(program, vtx);
+	glAttachShader(program, frag);
+	glBindAttribLocation(program, 0, attrib0);
+	glLinkProgram(program);
+	glDeleteShader(vtx);
+	glDeleteShader(frag);
+	GLint linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked ? program : 0;
+}
+
+// Issue the records up to the end of the next frame. Return false at the end
+// of the trace, or on a record it cannot replay.
+static bool replayFrame(struct replay *const r) {
+	while (r->p < r->end) {
+		const enum traceOp op = *r->p++;
+		uint32_t a[8], len;
+		const void *data;
+		switch (op) {
+		case OP_FRAME:
+			return true;
+		case OP_PROGRAM: {
+			a[0] = getWord(r);
+			const char *const attrib0 = getData(r, &len);
+			const char *const vtx_src = getData(r, &len);
+			const char *const frag_src = getData(r, &len);
+			const GLuint program = attrib0 && vtx_src && frag_src ?
+				replayProgram(attrib0, vtx_src, frag_src) : 0;
+			if (!program) {
+				fprintf(stderr, "REPLAY: could not build program %u\n", a[0]);
+				r->failed = true;
+				return false;
+			}
+			setName(&r->programs, a[0], program);
+			break;
+		}
+		case OP_ACTIVE_TEXTURE:
+			glActiveTexture(getWord(r));
+			break;
+		case OP_BIND_TEXTURE:
+			a[0] = getWord(r);
+			glBindTexture(a[0], mapName(&r->textures, getWord(r)));
+			break;
+		case OP_USE_PROGRAM:
+			r->program = getWord(r);
+			glUseProgram(mapName(&r->programs, r->program));
+			break;
+		case OP_BIND_FRAMEBUFFER:
+			a[0] = getWord(r);
+			glBindFramebuffer(a[0], mapName(&r->framebuffers, getWord(r)));
+			break;
+		case OP_BIND_BUFFER:
+			a[0] = getWord(r);
+			glBindBuffer(a[0], mapName(&r->buffers, getWord(r)));
+			break;
+		case OP_BIND_RENDERBUFFER:
+			a[0] = getWord(r);
+			glBindRenderbuffer(a[0], mapName(&r->renderbuffers, getWord(r)));
+			break;
+		case OP_BUFFER_DATA:
+			for (int i = 0; i < 3; i++)
+				a[i] = getWord(r);
+			data = getData(r, &len);
+			if (!enoughData(r, data, len, a[2], "glBufferData()"))
+				return false;
+			glBufferData(a[0], a[2], data, a[1]);
+			break;
+		case OP_BUFFER_SUB_DATA:
+			for (int i = 0; i < 2; i++)
+				a[i] = getWord(r);
+			data = getData(r, &len);
+			if (data)
+				glBufferSubData(a[0], a[1], len, data);
+			break;
+		case OP_VERTEX_ATTRIB_POINTER:
+			for (int i = 0; i < 6; i++)
+				a[i] = getWord(r);
+			glVertexAttribPointer(a[0], a[1], a[2], a[3], a[4],
+				(const void *)(size_t)a[5]);
+			break;
+		case OP_ENABLE_VERTEX_ATTRIB_ARRAY:
+			glEnableVertexAttribArray(getWord(r));
+			break;
+		case OP_ENABLE:
+			glEnable(getWord(r));
+			break;
+		case OP_DISABLE:
+			glDisable(getWord(r));
+			break;
+		case OP_BLEND_FUNC:
+			a[0] = getWord(r);
+			glBlendFunc(a[0], getWord(r));
+			break;
+		case OP_BLEND_FUNC_SEPARATE:
+			for (int i = 0; i < 4; i++)
+				a[i] = getWord(r);
+			glBlendFuncSeparate(a[0], a[1], a[2], a[3]);
+			break;
+		case OP_DEPTH_MASK:
+			glDepthMask(getWord(r));
+			break;
+		case OP_DEPTH_FUNC:
+			glDepthFunc(getWord(r));
+			break;
+		case OP_DEPTH_RANGEF: {
+			const float n = getFloat(r);
+			glDepthRangef(n, getFloat(r));
+			break;
+		}
+		case OP_GET_UNIFORM_LOCATION: {
+			a[0] = getWord(r);
+			a[1] = getWord(r);
+			const char *const name = getData(r, &len);
+			r->uniforms = nnrealloc(r->uniforms,
+				(r->nUniforms + 1) * sizeof(struct uniformMap));
+			r->uniforms[r->nUniforms++] = (struct uniformMap){ a[0], a[1],
+				name ? glGetUniformLocation(mapName(&r->programs, a[0]), name) :
+				-1 };
+			break;
+		}
+		case OP_UNIFORM2F: {
+			const GLint location = getWord(r);
+			const float v0 = getFloat(r), v1 = getFloat(r);
+			for (size_t i = 0; i < r->nUniforms; i++)
+				if (r->uniforms[i].program == r->program &&
+					r->uniforms[i].location == location) {
+					glUniform2f(r->uniforms[i].replayLocation, v0, v1);
+					break;
+				}
+			break;
+		}
+		case OP_VIEWPORT:
+			for (int i = 0; i < 4; i++)
+				a[i] = getWord(r);
+			glViewport(a[0], a[1], a[2], a[3]);
+			break;
+		case OP_DRAW_ELEMENTS:
+			for (int i = 0; i < 4; i++)
+				a[i] = getWord(r);
+			glDrawElements(a[0], a[1], a[2], (const void *)(size_t)a[3]);
+			break;
+		case OP_CLEAR:
+			glClear(getWord(r));
+			break;
+		case OP_CLEAR_COLOR: {
+			float c[4];
+			for (int i = 0; i < 4; i++)
+				c[i] = getFloat(r);
+			glClearColor(c[0], c[1], c[2], c[3]);
+			break;
+		}
+		case OP_TEX_IMAGE_2D:
+			for (int i = 0; i < 8; i++)
+				a[i] = getWord(r);
+			data = getData(r, &len);
+			if (!enoughData(r, data, len, imageBytes(a[3], a[4], a[6], a[7]),
+				"glTexImage2D()"))
+				return false;
+			glTexImage2D(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], data);
+			break;
+		case OP_TEX_PARAMETERI:
+			for (int i = 0; i < 3; i++)
+				a[i] = getWord(r);
+			glTexParameteri(a[0], a[1], a[2]);
+			break;
+		case OP_TEX_PARAMETERF: {
+			a[0] = getWord(r);
+			a[1] = getWord(r);
+			glTexParameterf(a[0], a[1], getFloat(r));
+			break;
+		}
+		case OP_GEN_TEXTURES:
+			replayGen(r, &r->textures, glGenTextures);
+			break;
+		case OP_DELETE_TEXTURES: {
+			const GLuint *const names = getData(r, &len);
+			for (size_t i = 0; names && i < len / sizeof(GLuint); i++) {
+				GLuint name;
+				memcpy(&name, &names[i], sizeof(name));
+				const GLuint replayName = mapName(&r->textures, name);
+				glDeleteTextures(1, &replayName);
+				setName(&r->textures, name, 0);
+			}
+			break;
+		}
+		case OP_GEN_BUFFERS:
+			replayGen(r, &r->buffers, glGenBuffers);
+			break;
+		case OP_GEN_FRAMEBUFFERS:
+			replayGen(r, &r->framebuffers, glGenFramebuffers);
+			break;
+		case OP_GEN_RENDERBUFFERS:
+			replayGen(r, &r->renderbuffers, glGenRenderbuffers);
+			break;
+		case OP_RENDERBUFFER_STORAGE:
+			for (int i = 0; i < 4; i++)
+				a[i] = getWord(r);
+			glRenderbufferStorage(a[0], a[1], a[2], a[3]);
+			break;
+		case OP_FRAMEBUFFER_TEXTURE_2D:
+			for (int i = 0; i < 5; i++)
+				a[i] = getWord(r);
+			glFramebufferTexture2D(a[0], a[1], a[2],
+				mapName(&r->textures, a[3]), a[4]);
+			break;
+		case OP_FRAMEBUFFER_RENDERBUFFER:
+			for (int i = 0; i < 4; i++)
+				a[i] = getWord(r);
+			glFramebufferRenderbuffer(a[0], a[1], a[2],
+				mapName(&r->renderbuffers, a[3]));
+			break;
+		default:
+			fprintf(stderr, "REPLAY: unknown op %d\n", op);
+			r->failed = true;
+			return false;
+		}
+		if (r->failed)
+			return false;
+	}
+	return false;
+}
+
+static int cmpForInt64_t(const void *p, const void *q) {
+	const int64_t a = *(const int64_t *)p, b = *(const int64_t *)q;
+	return a < b ? -1 : a > b;
+}
+
+// Entry point for `stl_player --replay trace [times.txt]`, with a current GL
+// context. Issue every frame of the trace as fast as possible, each followed by
+// a glFinish(), and print how long the GL took per frame. Write each frame's
+// issue and finish times (in us) to times.txt if given.
+bool replayTrace(const char *const path, const char *const timesPath) {
+	ssize_t len;
+	uint8_t *const trace = (uint8_t *)safe_read(path, &len);
+	if (!trace || len < (ssize_t)sizeof(kTraceMagic) ||
+		memcmp(trace, kTraceMagic, sizeof(kTraceMagic))) {
+		fprintf(stderr, "REPLAY: %s is not a trace\n", path);
+		free(trace);
+		return false;
+	}
+	struct replay r = { .p = trace + sizeof(kTraceMagic), .end = trace + len };
+	FILE *const times = timesPath ? fopen(timesPath, "w") : NULL;
+	must(!timesPath || times);
+
+	int64_t *frame_ns = NULL, issue_ns = 0, finish_ns = 0;
+	int frames = 0;
+	for (bool more = true; more && r.p < r.end; frames++) {
+		const int64_t start = monotonicNS();
+		more = replayFrame(&r);
+		const int64_t issued = monotonicNS();
+		glFinish();
+		const int64_t end = monotonicNS();
+		frame_ns = nnrealloc(frame_ns, (frames + 1) * sizeof(int64_t));
+		frame_ns[frames] = end - start;
+		if (frames > 0) {  // the first has the startup uploads
+			issue_ns += issued - start;
+			finish_ns += end - issued;
+		}
+		if (times)
+			fprintf(times, "%d %.1f %.1f\n", frames, (issued - start) / 1e3,
+				(end - issued) / 1e3);
+	}
+	if (times)
+		must(0 == fclose(times));
+
+	if (frames > 1) {
+		const int64_t first = frame_ns[0];
+		qsort(frame_ns + 1, frames - 1, sizeof(int64_t), cmpForInt64_t);
+		fprintf(stderr, "REPLAY: %d frames, first %.1f ms; then %.3f ms/frame "
+			"(%.3f ms issuing, %.3f ms in glFinish), median %.3f ms, "
+			"worst %.3f ms\n", frames, first / 1e6,
+			(issue_ns + finish_ns) / 1e6 / (frames - 1),
+			issue_ns / 1e6 / (frames - 1), finish_ns / 1e6 / (frames - 1),
+			frame_ns[1 + (frames - 1) / 2] / 1e6, frame_ns[frames - 1] / 1e6);
+	}
+	free(frame_ns);
+	free(r.textures.names);
+	free(r.buffers.names);
+	free(r.framebuffers.names);
+	free(r.renderbuffers.names);
+	free(r.programs.names);
+	free(r.uniforms);
+	free(trace);
+	return !r.failed && glGetError() == GL_NO_ERROR;
+}
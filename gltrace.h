@@ -0,0 +1,92 @@
+// gltrace.h
+
+#ifndef GLTRACE_H
+#define GLTRACE_H
+
+#include "linux-graphics.h"
+#include "std.h"
+
+// Recording the GL calls stlplayer.c makes into a trace file, for
+// `stl_player --replay`. See README-dev.md.
+void traceStart(void);
+bool tracing(void);
+void traceFrame(void);
+void traceProgram(const uint32_t, const char *const, const char *const,
+	const char *const);
+
+// The recorders. Each makes its GL call, then records it if a trace is on.
+void trActiveTexture(GLenum);
+void trBindTexture(GLenum, GLuint);
+void trUseProgram(GLuint);
+void trBindFramebuffer(GLenum, GLuint);
+void trBindBuffer(GLenum, GLuint);
+void trBindRenderbuffer(GLenum, GLuint);
+void trBufferData(GLenum, GLsizeiptr, const void *, GLenum);
+void trBufferSubData(GLenum, GLintptr, GLsizeiptr, const void *);
+void trVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei,
+	const void *);
+void trEnableVertexAttribArray(GLuint);
+void trEnable(GLenum);
+void trDisable(GLenum);
+void trBlendFunc(GLenum, GLenum);
+void trBlendFuncSeparate(GLenum, GLenum, GLenum, GLenum);
+void trDepthMask(GLboolean);
+void trDepthFunc(GLenum);
+void trDepthRangef(GLfloat, GLfloat);
+GLint trGetUniformLocation(GLuint, const GLchar *);
+void trUniform2f(GLint, GLfloat, GLfloat);
+void trViewport(GLint, GLint, GLsizei, GLsizei);
+void trDrawElements(GLenum, GLsizei, GLenum, const void *);
+void trClear(GLbitfield);
+void trClearColor(GLfloat, GLfloat, GLfloat, GLfloat);
+void trTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum,
+	GLenum, const void *);
+void trTexParameteri(GLenum, GLenum, GLint);
+void trTexParameterf(GLenum, GLenum, GLfloat);
+void trGenTextures(GLsizei, GLuint *);
+void trDeleteTextures(GLsizei, const GLuint *);
+void trGenBuffers(GLsizei, GLuint *);
+void trGenFramebuffers(GLsizei, GLuint *);
+void trGenRenderbuffers(GLsizei, GLuint *);
+void trRenderbufferStorage(GLenum, GLenum, GLsizei, GLsizei);
+void trFramebufferTexture2D(GLenum, GLenum, GLenum, GLuint, GLint);
+void trFramebufferRenderbuffer(GLenum, GLenum, GLenum, GLuint);
+
+#ifndef GLTRACE_C  // everyone else's GL calls go through the recorders
+#define glActiveTexture trActiveTexture
+#define glBindTexture trBindTexture
+#define glUseProgram trUseProgram
+#define glBindFramebuffer trBindFramebuffer
+#define glBindBuffer trBindBuffer
+#define glBindRenderbuffer trBindRenderbuffer
+#define glBufferData trBufferData
+#define glBufferSubData trBufferSubData
+#define glVertexAttribPointer trVertexAttribPointer
+#define glEnableVertexAttribArray trEnableVertexAttribArray
+#define glEnable trEnable
+#define glDisable trDisable
+#define glBlendFunc trBlendFunc
+#define glBlendFuncSeparate trBlendFuncSeparate
+#define glDepthMask trDepthMask
+#define glDepthFunc trDepthFunc
+#define glDepthRangef trDepthRangef
+#define glGetUniformLocation trGetUniformLocation
+#define glUniform2f trUniform2f
+#define glViewport trViewport
+#define glDrawElements trDrawElements
+#define glClear trClear
+#define glClearColor trClearColor
+#define glTexImage2D trTexImage2D
+#define glTexParameteri trTexParameteri
+#define glTexParameterf trTexParameterf
+#define glGenTextures trGenTextures
+#define glDeleteTextures trDeleteTextures
+#define glGenBuffers trGenBuffers
+#define glGenFramebuffers trGenFramebuffers
+#define glGenRenderbuffers trGenRenderbuffers
+#define glRenderbufferStorage trRenderbufferStorage
+#define glFramebufferTexture2D trFramebufferTexture2D
+#define glFramebufferRenderbuffer trFramebufferRenderbuffer
+#endif
+
+#endif
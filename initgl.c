@@ -1,8 +1,10 @@
 #include "initgl.h"
 
-static egl_dat initializeEgl(void) {
+// surfaceType is EGL_WINDOW_BIT or EGL_PBUFFER_BIT. The context is GLES2's,
+// or a desktop GL 3.3 core profile one for gl33render.c.
+static egl_dat initializeEgl(EGLDisplay d, const EGLint surfaceType) {
 	egl_dat ed;
-	ed.d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	ed.d = d;
 	assert(ed.d != EGL_NO_DISPLAY);
 	
 	EGLint ret;
@@ -10,28 +12,40 @@ static egl_dat initializeEgl(void) {
 	ret = eglInitialize(ed.d, NULL, NULL);
 	assert(ret == EGL_TRUE);
 	
-	ret = eglBindAPI(EGL_OPENGL_ES_API);
+	const bool gl33 = usingGL33Renderer();
+	ret = eglBindAPI(gl33 ? EGL_OPENGL_API : EGL_OPENGL_ES_API);
 	assert(ret == EGL_TRUE);
 	
 	const EGLint attrib_list[] = {
 		EGL_ALPHA_SIZE, 8,
 		EGL_BLUE_SIZE, 8,
-		EGL_CONFORMANT, EGL_OPENGL_ES2_BIT,
+		EGL_CONFORMANT, gl33 ? EGL_OPENGL_BIT : EGL_OPENGL_ES2_BIT,
+		EGL_RENDERABLE_TYPE, gl33 ? EGL_OPENGL_BIT : EGL_OPENGL_ES_BIT,
 		EGL_GREEN_SIZE, 8,
 		EGL_RED_SIZE, 8,
 		EGL_DEPTH_SIZE, 24,
 		EGL_STENCIL_SIZE, 8,
+		EGL_SURFACE_TYPE, surfaceType,
 		EGL_NONE
 	};
 	EGLint num_config;
 	ret = eglChooseConfig(ed.d, attrib_list, ed.cfg, 1, &num_config);
 	assert(ret == EGL_TRUE);
+	must(num_config == 1);
 	
 	// hxxps://community.arm.com/developer/tools-software/oss-platforms
 	// /b/android-blog/posts/check-your-context-if-glcreateshader-returns-0
 	// -and-gl_5f00_invalid_5f00_operation
 	EGLint attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
-	ed.cxt = eglCreateContext(ed.d, ed.cfg[0], EGL_NO_CONTEXT, attribs);
+	const EGLint gl33Attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	ed.cxt = eglCreateContext(ed.d, ed.cfg[0], EGL_NO_CONTEXT,
+		gl33 ? gl33Attribs : attribs);
+	must(ed.cxt != EGL_NO_CONTEXT);
 	
 	assert(eglGetError() == EGL_SUCCESS);
 	
@@ -91,6 +105,12 @@ static void initializeSurface(egl_dat *ed, x_dat *xd) {
 	int ret;
 	ret = eglMakeCurrent(ed->d, ed->s, ed->s, ed->cxt);
 	assert(ret == EGL_TRUE);
+	
+	// vsync by default; STL_PLAYER_SWAP_INTERVAL=0 turns it off
+	const char *const swapInterval = getenv("STL_PLAYER_SWAP_INTERVAL");
+	const int interval = swapInterval ? atoi(swapInterval) : 1;
+	ret = eglSwapInterval(ed->d, interval);
+	setSwapInterval(ret == EGL_TRUE ? interval : 0);
 }
 
 // Terminate the X11 event pump thread and destroy the global mutex.
@@ -114,6 +134,15 @@ static void terminatePXEthread(
 	mtx_destroy(pmtx);
 }
 
+// Where the software renderer's frames go on screen: a connection of the
+// render thread's own (the event pump blocks in XNextEvent with the display
+// locked), and an image the size of the window.
+struct softPresenter {
+	Display *d;
+	GC gc;
+	XImage *img;
+};
+
 struct goodies {
 	keys k;
 	thrd_t thr;
@@ -124,6 +153,8 @@ struct goodies {
 	int resolutionWidth, resolutionHeight;
 	egl_dat ed;
 	x_dat xd;
+	bool soft;  // STL_PLAYER_RENDERER=soft: no EGL, present with XPutImage
+	struct softPresenter sp;
 };
 
 static bool cleanup(
@@ -140,21 +171,28 @@ static bool cleanup(
 	);
 	free(threadArgs);
 	
-	ret = eglMakeCurrent(
-		goodies->ed.d,
-		EGL_NO_SURFACE,
-		EGL_NO_SURFACE,
-		EGL_NO_CONTEXT
-	);
-	assert(ret == EGL_TRUE);
-	ret = eglDestroyContext(goodies->ed.d, goodies->ed.cxt);
-	assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY &&
-		ret != EGL_NOT_INITIALIZED && ret != EGL_BAD_CONTEXT);
-	ret = eglDestroySurface(goodies->ed.d, goodies->ed.s);
-	assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY &&
-		ret != EGL_NOT_INITIALIZED && ret != EGL_BAD_SURFACE);
-	ret = eglTerminate(goodies->ed.d);
-	assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY);
+	if (goodies->soft) {
+		if (goodies->sp.img)
+			XDestroyImage(goodies->sp.img);
+		XFreeGC(goodies->sp.d, goodies->sp.gc);
+		XCloseDisplay(goodies->sp.d);
+	} else {
+		ret = eglMakeCurrent(
+			goodies->ed.d,
+			EGL_NO_SURFACE,
+			EGL_NO_SURFACE,
+			EGL_NO_CONTEXT
+		);
+		assert(ret == EGL_TRUE);
+		ret = eglDestroyContext(goodies->ed.d, goodies->ed.cxt);
+		assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY &&
+			ret != EGL_NOT_INITIALIZED && ret != EGL_BAD_CONTEXT);
+		ret = eglDestroySurface(goodies->ed.d, goodies->ed.s);
+		assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY &&
+			ret != EGL_NOT_INITIALIZED && ret != EGL_BAD_SURFACE);
+		ret = eglTerminate(goodies->ed.d);
+		assert(ret != EGL_FALSE && ret != EGL_BAD_DISPLAY);
+	}
 	
 	ret = XDestroyWindow(goodies->xd.d, goodies->xd.w);
 	assert(ret != BadWindow);
@@ -354,43 +392,136 @@ static void waitForThreadToLaunch(mtx_t *pmtx, const char *const pIsTiddyAlive)
 	}
 }
 
+static void initializeSoftPresenter(struct softPresenter *const sp) {
+	sp->d = XOpenDisplay(NULL);
+	must(sp->d != NULL);
+	must(DefaultDepth(sp->d, DefaultScreen(sp->d)) >= 24);
+	sp->gc = XCreateGC(sp->d, XDefaultRootWindow(sp->d), 0, NULL);
+	sp->img = NULL;
+}
+
+// Put the software renderer's framebuffer in the window, scaled up by the
+// largest whole factor that fits and centered, with black around it.
+static void softPresent(struct softPresenter *const sp, const Window w,
+	const int width, const int height) {
+	if (width <= 0 || height <= 0)
+		return;
+	if (!sp->img || sp->img->width != width || sp->img->height != height) {
+		if (sp->img)
+			XDestroyImage(sp->img);  // frees the pixels too
+		const int screen = DefaultScreen(sp->d);
+		sp->img = XCreateImage(sp->d, DefaultVisual(sp->d, screen),
+			DefaultDepth(sp->d, screen), ZPixmap, 0,
+			nnmalloc((size_t)width * height * 4), width, height, 32, 0);
+		must(sp->img != NULL && sp->img->bits_per_pixel == 32);
+	}
+	int scale = width / 640 < height / 480 ? width / 640 : height / 480;
+	if (scale < 1)
+		scale = 1;
+	const int x0 = (width - 640 * scale) / 2, y0 = (height - 480 * scale) / 2;
+	const uint32_t *const fb = softFramebuffer();
+	for (int y = 0; y < height; y++) {
+		uint32_t *const row = (uint32_t *)(sp->img->data +
+			(size_t)y * sp->img->bytes_per_line);
+		const int fy = y - y0 < 0 ? -1 : (y - y0) / scale;
+		for (int x = 0; x < width; x++) {
+			const int fx = x - x0 < 0 ? -1 : (x - x0) / scale;
+			row[x] = fy < 0 || fy >= 480 || fx < 0 || fx >= 640 ? 0 :
+				fb[fy * 640 + fx] & 0xffffff;
+		}
+	}
+	XPutImage(sp->d, w, sp->gc, sp->img, 0, 0, 0, 0, width, height);
+	XFlush(sp->d);
+}
+
+// Draw frames until Esc. Unless STL_PLAYER_NO_RENDER_THREAD is set, the game
+// is simulated on a thread of its own, and this (render) thread only draws its
+// snapshots and swaps.
 static void mainLoop(struct goodies *const goodies) {
-	struct timespec prev = { 0 };
+	const bool renderThread = getenv("STL_PLAYER_NO_RENDER_THREAD") == NULL;
+	if (renderThread)
+		startSimulation(&goodies->k, &goodies->tiddyMtx);
+	else
+		fprintf(stderr, "DEBUG: render thread disabled\n");
+	
+	int64_t prev = monotonicNS(), lastFrame = prev, frameMax_ns = 0;
+	int64_t prevCPU = processCPUNS(), prevThreadCPU = threadCPUNS();
 	uint64_t frames = 0;
+	int64_t swap_ns = 0;
 	for (;;) {
-		struct timespec now = { 0 };
-		assert(TIME_UTC == timespec_get(&now, TIME_UTC));
-		if (elapsedTimeGreaterThanNS(&prev, &now, NSONE)) {
+		const int64_t now = monotonicNS();
+		if (now - prev >= NSONE) {
+			const int64_t cpu = processCPUNS(), threadCPU = threadCPUNS();
+			fprintf(stderr, "DEBUG: %llu frames, %.2f ms/frame (max %.2f), "
+				"%.1f us/swap, CPU %.0f%% (render thread %.0f%%)\n",
+				(long long unsigned)frames,
+				frames ? (now - prev) / 1e6 / frames : 0.0, frameMax_ns / 1e6,
+				frames ? swap_ns / 1000.0 / frames : 0.0,
+				100.0 * (cpu - prevCPU) / (now - prev),
+				100.0 * (threadCPU - prevThreadCPU) / (now - prev));
+			printRenderStats();
 			prev = now;
-			fprintf(stderr, "DEBUG: %llu frames\n", (long long unsigned)frames);
+			prevCPU = cpu;
+			prevThreadCPU = threadCPU;
 			frames = 0;
+			frameMax_ns = 0;
+			swap_ns = 0;
 		}
 
-		mutexLock(&goodies->tiddyMtx);
-		mutexLock(&goodies->resolutionMtx);
 		int ret;
-		ret = draw(
-			&goodies->k,
-			&goodies->resolutionWidth,
-			&goodies->resolutionHeight
-		);
-		mutexUnlock(&goodies->resolutionMtx);
-		mutexUnlock(&goodies->tiddyMtx);
+		if (renderThread) {
+			mutexLock(&goodies->resolutionMtx);
+			const int width = goodies->resolutionWidth;
+			const int height = goodies->resolutionHeight;
+			mutexUnlock(&goodies->resolutionMtx);
+			const bool drawn = renderFrame(&width, &height);
+			mutexLock(&goodies->tiddyMtx);
+			ret = goodies->isTiddyAlive;
+			mutexUnlock(&goodies->tiddyMtx);
+			if (ret && !drawn)
+				continue;  // nothing new to show
+		} else {
+			mutexLock(&goodies->tiddyMtx);
+			mutexLock(&goodies->resolutionMtx);
+			ret = draw(
+				&goodies->k,
+				&goodies->resolutionWidth,
+				&goodies->resolutionHeight
+			);
+			mutexUnlock(&goodies->resolutionMtx);
+			mutexUnlock(&goodies->tiddyMtx);
+		}
 		if (!goodies->isTiddyAlive || !ret)
-			return;
+			break;
 		
-		eglSwapBuffers(goodies->ed.d, goodies->ed.s);
+		const int64_t swapStart = monotonicNS();
+		if (goodies->soft) {
+			mutexLock(&goodies->resolutionMtx);
+			const int width = goodies->resolutionWidth;
+			const int height = goodies->resolutionHeight;
+			mutexUnlock(&goodies->resolutionMtx);
+			softPresent(&goodies->sp, goodies->xd.w, width, height);
+		} else
+			eglSwapBuffers(goodies->ed.d, goodies->ed.s);
+		const int64_t swapEnd = monotonicNS();
+		swap_ns += swapEnd - swapStart;
+		if (swapEnd - lastFrame > frameMax_ns)
+			frameMax_ns = swapEnd - lastFrame;
+		lastFrame = swapEnd;
 		frames++;
 	}
 	
-	must(false);
-	return;
+	if (renderThread)
+		stopSimulation();
 }
 
 static void *initialize(struct goodies *goodies) {
 	int ret;
 	
-	goodies->ed = initializeEgl();
+	goodies->soft = usingSoftRenderer();
+	if (!goodies->soft)
+		goodies->ed = initializeEgl(eglGetDisplay(EGL_DEFAULT_DISPLAY),
+			EGL_WINDOW_BIT);
 	ret = mtx_init(&goodies->resolutionMtx, mtx_plain);
 	assert(ret == thrd_success);
 	goodies->xd = initializeXwin(
@@ -398,13 +529,18 @@ static void *initialize(struct goodies *goodies) {
 		&goodies->resolutionWidth,
 		&goodies->resolutionHeight
 	);
-	initializeSurface(&goodies->ed, &goodies->xd);
-	
-	// The thread hasn't been created yet, so can use w/out locking a mutex.
-	glViewport(0, 0, goodies->resolutionWidth, goodies->resolutionHeight);
-	glEnable(GL_BLEND);
-	// https://gamedev.stackexchange.com/questions/32027/
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	if (goodies->soft) {
+		initializeSoftPresenter(&goodies->sp);
+		setSwapInterval(0);  // no vsync to wait on
+	} else {
+		initializeSurface(&goodies->ed, &goodies->xd);
+		
+		// The thread hasn't been created yet, so can use w/out locking a mutex.
+		glViewport(0, 0, goodies->resolutionWidth, goodies->resolutionHeight);
+		glEnable(GL_BLEND);
+		// https://gamedev.stackexchange.com/questions/32027/
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
 	
 	ret = mtx_init(&goodies->tiddyMtx, mtx_plain);
 	assert(ret == thrd_success);
@@ -426,6 +562,150 @@ static void *initialize(struct goodies *goodies) {
 
 void terminate(void);
 
+// The display for --headless: Mesa's surfaceless platform if EGL has it (so no
+// X server is needed), otherwise the default one.
+static EGLDisplay headlessDisplay(void) {
+	const char *const exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	const PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+		"eglGetPlatformDisplayEXT");
+	if (exts && strstr(exts, "EGL_MESA_platform_surfaceless") &&
+		getPlatformDisplay) {
+		fprintf(stderr, "DEBUG: headless on EGL_MESA_platform_surfaceless\n");
+		return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+			EGL_DEFAULT_DISPLAY, NULL);
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// The size of the pbuffer for --headless and --replay. STL_PLAYER_HEADLESS_SIZE
+// =WxH stands in for a window of that size.
+static void headlessSize(int *const width, int *const height) {
+	*width = 640;
+	*height = 480;
+	const char *const size = getenv("STL_PLAYER_HEADLESS_SIZE");
+	if (size)
+		must(2 == sscanf(size, "%dx%d", width, height) &&
+			*width > 0 && *height > 0);
+}
+
+// Make a width x height pbuffer and a context for it current, set up like a
+// window's.
+static egl_dat makeHeadlessCurrent(const int width, const int height) {
+	egl_dat ed = initializeEgl(headlessDisplay(), EGL_PBUFFER_BIT);
+	const EGLint pbufferAttribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+	ed.s = eglCreatePbufferSurface(ed.d, ed.cfg[0], pbufferAttribs);
+	must(ed.s != EGL_NO_SURFACE);
+	EGLint ret = eglMakeCurrent(ed.d, ed.s, ed.s, ed.cxt);
+	assert(ret == EGL_TRUE);
+	glViewport(0, 0, width, height);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	return ed;
+}
+
+static void destroyHeadless(egl_dat *const ed) {
+	eglMakeCurrent(ed->d, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(ed->d, ed->cxt);
+	eglDestroySurface(ed->d, ed->s);
+	eglTerminate(ed->d);
+}
+
+// FNV-1a of n bytes, for the last frame's hash.
+static uint64_t hashBytes(const uint8_t *const p, const size_t n) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < n; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	return hash;
+}
+
+// Entry point for `stl_player --replay trace [times.txt]`. Replay a trace
+// recorded with STL_PLAYER_TRACE into a pbuffer (of the size it was recorded
+// at), without running the game, and print the hash of its last frame.
+static int runReplay(const char *const path, const char *const timesPath) {
+	int width, height;
+	headlessSize(&width, &height);
+	egl_dat ed = makeHeadlessCurrent(width, height);
+	const bool ok = replayTrace(path, timesPath);
+	uint8_t *const px = nnmalloc((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, px);
+	fprintf(stderr, "REPLAY: last frame hash %016llx\n",
+		(long long unsigned)hashBytes(px, (size_t)width * height * 4));
+	free(px);
+	destroyHeadless(&ed);
+	return ok ? 0 : 1;
+}
+
+// Entry point for `stl_player --headless [frames [out.ppm]]`. Render frames
+// (default 600) ticks of a scripted run to the right, jumping now and then,
+// into a pbuffer as fast as possible. Print the time per frame and a hash of
+// the last frame, and write the last frame to out.ppm if given.
+static int runHeadless(const int frames, const char *const ppmPath) {
+	int width = 640, height = 480;
+	const bool soft = usingSoftRenderer();
+	egl_dat ed = { 0 };
+	if (!soft) {
+		headlessSize(&width, &height);
+		ed = makeHeadlessCurrent(width, height);
+	}
+	
+	keys k = { 0 };
+	core(&k, false, &width, &height);  // initialize outside the timing
+	const int64_t start = monotonicNS(), startCPU = processCPUNS();
+	for (int i = 0; i < frames; i++) {
+		// run right, jumping every 40 frames; when Tux dies (or finishes the
+		// level), press Enter to start over, so the run keeps scrolling
+		k.keyRight = true;
+		k.keyUp = i % 40 < 25;  // long enough to clear the walls
+		k.keyEnter = displayingMessage;
+		core(&k, !displayingMessage, &width, &height);
+		if (i % 60 == 59)
+			printRenderStats();
+	}
+	if (!soft)
+		glFinish();
+	const int64_t elapsed = monotonicNS() - start;
+	fprintf(stderr, "HEADLESS: %d frames at %dx%d, %.3f ms/frame, CPU %.0f%%\n",
+		frames, width, height, frames ? elapsed / 1e6 / frames : 0.0,
+		100.0 * (processCPUNS() - startCPU) / elapsed);
+	
+	uint8_t *const px = nnmalloc((size_t)width * height * 4);
+	if (soft) {  // the GL's layout: RGBA, rows from the bottom
+		const uint32_t *const fb = softFramebuffer();
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++) {
+				const uint32_t c = fb[(height - 1 - y) * width + x];
+				uint8_t *const p = &px[((size_t)y * width + x) * 4];
+				p[0] = c >> 16;
+				p[1] = c >> 8;
+				p[2] = c;
+				p[3] = c >> 24;
+			}
+	} else
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, px);
+	fprintf(stderr, "HEADLESS: last frame hash %016llx\n",
+		(long long unsigned)hashBytes(px, (size_t)width * height * 4));
+	if (ppmPath) {
+		FILE *const f = fopen(ppmPath, "wb");
+		must(f != NULL);
+		fprintf(f, "P6 %d %d 255\n", width, height);
+		for (int y = height - 1; y >= 0; y--)  // GL rows go bottom-up
+			for (int x = 0; x < width; x++)
+				must(3 == fwrite(&px[((size_t)y * width + x) * 4], 1, 3, f));
+		must(0 == fclose(f));
+	}
+	free(px);
+	
+	terminate();
+	if (!soft)
+		destroyHeadless(&ed);
+	return 0;
+}
+
 struct goodies *initializeGoodies(struct goodies *goodies) {
 	goodies->tiddy = 1;
 	goodies->isTiddyAlive = -1;
@@ -435,7 +715,13 @@ struct goodies *initializeGoodies(struct goodies *goodies) {
 }
 
 int main(int argc, char *argv[]) {
-	argv[0][0] += argc - argc;
+	if (argc > 1 && 0 == strcmp(argv[1], "--bench-io"))
+		return benchAssets() ? 0 : 1;
+	if (argc > 1 && 0 == strcmp(argv[1], "--headless"))
+		return runHeadless(argc > 2 ? atoi(argv[2]) : 600,
+			argc > 3 ? argv[3] : NULL);
+	if (argc > 2 && 0 == strcmp(argv[1], "--replay"))
+		return runReplay(argv[2], argc > 3 ? argv[3] : NULL);
 	
 	struct goodies goodies = { 0 };
 	void *threadArgs = initialize(initializeGoodies(&goodies));
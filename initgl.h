@@ -11,7 +11,20 @@
 int kill(pid_t, int);
 pid_t gettid(void);
 
+extern bool displayingMessage;
+
 bool draw(keys *const, const int *const, const int *const);
+void core(keys *const, bool, const int *const, const int *const);
+bool benchAssets(void);
+bool replayTrace(const char *const, const char *const);
+void printRenderStats(void);
+void startSimulation(const keys *const, mtx_t *const);
+void stopSimulation(void);
+bool renderFrame(const int *const, const int *const);
+void setSwapInterval(const int);
+bool usingSoftRenderer(void);
+bool usingGL33Renderer(void);
+const uint32_t *softFramebuffer(void);
 bool elapsedTimeGreaterThanNS(struct timespec *const,
 	struct timespec *const, int64_t);
 
@@ -108,12 +108,13 @@ void stlPrinter(const stl *const lvl) {
 		fprintf(stderr, "WARN: lvl.height unexpected (%d)\n", lvl->height);
 }
 
+// Parse the level file at filename, a path relative to the data directories.
 stl levelReader(const char *const filename) {
 	stl lvl = { 0 };
 	lvl.height = 15;  // some STLs don't include the level height
 	
 	ssize_t level_len_ss;
-	char *file = safe_read(filename, &level_len_ss);
+	char *file = vfsRead(filename, &level_len_ss);
 	if (!file || level_len_ss < 1) {
 		lvl.hdr = false;
 		return lvl;
@@ -4,11 +4,13 @@
 #define LINUXGRAPHICS_H
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
 #include <X11/Xlib.h>
 #include <X11/XKBlib.h>
+#include <X11/Xutil.h>
 
 struct egl_data {
 	EGLDisplay d;
@@ -0,0 +1,378 @@
+// softrender.c
+#define _GNU_SOURCE  // sysconf()
+
+// A CPU rasterizer for when there is no usable GL. It takes the quads the
+// batcher would have drawn, bins them into screen tiles, and has a pool of
+// threads draw the tiles into a 640x480 framebuffer.
+
+#include "stlplayer.h"
+
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+enum {
+	SOFT_WIDTH = 640, SOFT_HEIGHT = 480,
+	SOFT_TILE = 64,  // screen tiles are SOFT_TILE x SOFT_TILE pixels
+	SOFT_TILES_X = (SOFT_WIDTH + SOFT_TILE - 1) / SOFT_TILE,
+	SOFT_TILES_Y = (SOFT_HEIGHT + SOFT_TILE - 1) / SOFT_TILE,
+	SOFT_NTILES = SOFT_TILES_X * SOFT_TILES_Y,
+	SOFT_MAX_THREADS = 16,
+};
+
+// Texels are 0xAARRGGBB, like the framebuffer (and a 24/32-bit X visual).
+struct softTexture {
+	int width, height;
+	bool hasAlpha;
+	uint32_t *texels;
+};
+
+// A queued quad: it covers pixels [x0, x1) x [y0, y1), rows counted from the
+// top. (u0, v0) is the texel position at the center of pixel (x0, y0), and
+// (du, dv) the step per pixel, all in 16.16 fixed point.
+struct softQuad {
+	int x0, y0, x1, y1;
+	int64_t u0, v0, du, dv;
+	uint32_t texnam;
+};
+
+// The quads that touch one screen tile, in drawing order.
+struct softBin {
+	uint32_t *quads;
+	size_t len, cap;
+};
+
+static struct {
+	uint32_t fb[SOFT_WIDTH * SOFT_HEIGHT];  // rows from the top
+	uint32_t clearColor;
+
+	struct softTexture *textures;  // indexed by texnam; 0 is never used
+	size_t nTextures;
+
+	struct softQuad *quads;
+	size_t nQuads, capQuads;
+	struct softBin bins[SOFT_NTILES];
+
+	thrd_t threads[SOFT_MAX_THREADS];
+	int nThreads;  // workers, not counting the thread calling softFinishFrame
+	mtx_t mtx;
+	cnd_t start, done;
+	uint64_t frame;  // bumped to start the workers on a frame
+	int working;  // workers not done with the current frame
+	bool quit;
+	atomic_int nextTile;
+} gSoft;
+
+// Pick the software renderer with STL_PLAYER_RENDERER=soft.
+bool usingSoftRenderer(void) {
+	static int soft = -1;
+	if (soft == -1) {
+		const char *const renderer = getenv("STL_PLAYER_RENDERER");
+		soft = renderer && 0 == strcmp(renderer, "soft");
+	}
+	return soft;
+}
+
+static uint32_t softGenTexture(void) {
+	gSoft.textures = nnrealloc(gSoft.textures,
+		(gSoft.nTextures + 2) * sizeof(struct softTexture));
+	if (gSoft.nTextures == 0)
+		gSoft.textures[gSoft.nTextures++] = (struct softTexture){ 0 };
+	gSoft.textures[gSoft.nTextures] = (struct softTexture){ 0 };
+	return gSoft.nTextures++;
+}
+
+static void softTexImage(const uint32_t texnam, const int width, const int height,
+	const char *const texels, const bool hasAlpha) {
+	must(texnam > 0 && texnam < gSoft.nTextures);
+	struct softTexture *const tex = &gSoft.textures[texnam];
+	free(tex->texels);
+	tex->width = width;
+	tex->height = height;
+	tex->hasAlpha = hasAlpha;
+	tex->texels = nnmalloc((size_t)width * height * sizeof(uint32_t));
+	const uint8_t *src = (const uint8_t *)texels;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		const uint32_t a = hasAlpha ? src[3] : 0xff;
+		tex->texels[i] = a << 24 | (uint32_t)src[0] << 16 |
+			(uint32_t)src[1] << 8 | src[2];
+		src += hasAlpha ? 4 : 3;
+	}
+}
+
+static void softClear(const uint32_t color) {
+	gSoft.clearColor = color;
+	gSoft.nQuads = 0;
+	for (int i = 0; i < SOFT_NTILES; i++)
+		gSoft.bins[i].len = 0;
+}
+
+static void binQuad(const uint32_t idx) {
+	const struct softQuad *const q = &gSoft.quads[idx];
+	for (int ty = q->y0 / SOFT_TILE; ty <= (q->y1 - 1) / SOFT_TILE; ty++)
+		for (int tx = q->x0 / SOFT_TILE; tx <= (q->x1 - 1) / SOFT_TILE; tx++) {
+			struct softBin *const bin = &gSoft.bins[ty * SOFT_TILES_X + tx];
+			if (bin->len == bin->cap) {
+				bin->cap = bin->cap ? bin->cap * 2 : 64;
+				bin->quads = nnrealloc(bin->quads, bin->cap * sizeof(uint32_t));
+			}
+			bin->quads[bin->len++] = idx;
+		}
+}
+
+// Queue n quads in the batcher's layout.
+static void softQueueQuads(const float *const verts, const uint32_t *const texnams,
+	const size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		const float *const v = &verts[i * 16];
+		if (texnams[i] == 0 || texnams[i] >= gSoft.nTextures ||
+			!gSoft.textures[texnams[i]].texels)
+			continue;
+		const struct softTexture *const tex = &gSoft.textures[texnams[i]];
+
+		float left = v[0], right = v[8], top = v[1], bottom = v[5];
+		float sLeft = v[2], sRight = v[10], tTop = v[3], tBottom = v[7];
+		if (left > right) {
+			float f = left; left = right; right = f;
+			f = sLeft; sLeft = sRight; sRight = f;
+		}
+		if (bottom > top) {
+			float f = top; top = bottom; bottom = f;
+			f = tTop; tTop = tBottom; tBottom = f;
+		}
+		if (right <= left || top <= bottom)
+			continue;
+
+		// pixels whose centers are inside, like the GL's rasterization
+		struct softQuad q;
+		q.x0 = (int)ceilf(left - 0.5f);
+		q.x1 = (int)ceilf(right - 0.5f);
+		q.y0 = (int)floorf(SOFT_HEIGHT - 0.5f - top) + 1;
+		q.y1 = (int)floorf(SOFT_HEIGHT - 0.5f - bottom) + 1;
+		const double du = (sRight - sLeft) * tex->width / (right - left);
+		const double dv = (tBottom - tTop) * tex->height / (top - bottom);
+		q.u0 = (sLeft * tex->width + (q.x0 + 0.5 - left) * du) * 65536;
+		q.v0 = (tTop * tex->height + (q.y0 + 0.5 - (SOFT_HEIGHT - top)) * dv) *
+			65536;
+		q.du = du * 65536;
+		q.dv = dv * 65536;
+		q.texnam = texnams[i];
+
+		// clip to the screen
+		if (q.x0 < 0) {
+			q.u0 -= q.x0 * q.du;
+			q.x0 = 0;
+		}
+		if (q.y0 < 0) {
+			q.v0 -= q.y0 * q.dv;
+			q.y0 = 0;
+		}
+		if (q.x1 > SOFT_WIDTH)
+			q.x1 = SOFT_WIDTH;
+		if (q.y1 > SOFT_HEIGHT)
+			q.y1 = SOFT_HEIGHT;
+		if (q.x0 >= q.x1 || q.y0 >= q.y1)
+			continue;
+
+		if (gSoft.nQuads == gSoft.capQuads) {
+			gSoft.capQuads = gSoft.capQuads ? gSoft.capQuads * 2 : 1024;
+			gSoft.quads = nnrealloc(gSoft.quads,
+				gSoft.capQuads * sizeof(struct softQuad));
+		}
+		gSoft.quads[gSoft.nQuads] = q;
+		binQuad(gSoft.nQuads++);
+	}
+}
+
+static inline int clampTexel(const int64_t fixed, const int size) {
+	const int64_t i = fixed >> 16;
+	return i < 0 ? 0 : i >= size ? size - 1 : (int)i;
+}
+
+// dst = src over dst, for one pixel.
+static inline uint32_t blendPixel(const uint32_t src, const uint32_t dst) {
+	const uint32_t a = src >> 24;
+	if (a == 0xff)
+		return src;
+	if (a == 0)
+		return dst;
+	uint32_t out = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		const uint32_t c = ((src >> shift) & 0xff) * a +
+			((dst >> shift) & 0xff) * (0xff - a) + 0x80;
+		out |= ((c + (c >> 8)) >> 8) << shift;  // c / 255, rounded
+	}
+	return out;
+}
+
+// Draw one row of q's texture into dst[0, n), starting at texel column u.
+static void drawSpan(uint32_t *const dst, const int n, const uint32_t *const row,
+	const int width, int64_t u, const int64_t du, const bool hasAlpha) {
+	int i = 0;
+	if (!hasAlpha) {
+		for (; i < n; i++, u += du)
+			dst[i] = row[clampTexel(u, width)];
+		return;
+	}
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ff = _mm_set1_epi16(0xff), round = _mm_set1_epi16(0x80);
+	for (; i + 4 <= n; i += 4, u += 4 * du) {
+		const __m128i src = _mm_set_epi32(
+			row[clampTexel(u + 3 * du, width)], row[clampTexel(u + 2 * du, width)],
+			row[clampTexel(u + du, width)], row[clampTexel(u, width)]);
+		const int alpha = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_srli_epi32(src, 24), _mm_set1_epi32(0xff)));
+		if ((alpha & 0x1111) == 0x1111) {  // all four opaque
+			_mm_storeu_si128((__m128i *)&dst[i], src);
+			continue;
+		}
+		if ((_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(src, 24),
+			zero)) & 0x1111) == 0x1111)  // all four transparent
+			continue;
+		const __m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+		__m128i out[2];
+		for (int half = 0; half < 2; half++) {
+			const __m128i s16 = half ? _mm_unpackhi_epi8(src, zero) :
+				_mm_unpacklo_epi8(src, zero);
+			const __m128i d16 = half ? _mm_unpackhi_epi8(d, zero) :
+				_mm_unpacklo_epi8(d, zero);
+			const __m128i a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16,
+				_MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m128i c = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s16, a16),
+				_mm_mullo_epi16(d16, _mm_sub_epi16(ff, a16))), round);
+			c = _mm_srli_epi16(_mm_add_epi16(c, _mm_srli_epi16(c, 8)), 8);
+			out[half] = c;
+		}
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(out[0], out[1]));
+	}
+#endif
+	for (; i < n; i++, u += du)
+		dst[i] = blendPixel(row[clampTexel(u, width)], dst[i]);
+}
+
+static void drawTile(const int t) {
+	const int tx0 = t % SOFT_TILES_X * SOFT_TILE;
+	const int ty0 = t / SOFT_TILES_X * SOFT_TILE;
+	const int tx1 = tx0 + SOFT_TILE < SOFT_WIDTH ? tx0 + SOFT_TILE : SOFT_WIDTH;
+	const int ty1 = ty0 + SOFT_TILE < SOFT_HEIGHT ? ty0 + SOFT_TILE : SOFT_HEIGHT;
+	for (int y = ty0; y < ty1; y++)
+		for (int x = tx0; x < tx1; x++)
+			gSoft.fb[y * SOFT_WIDTH + x] = gSoft.clearColor;
+
+	const struct softBin *const bin = &gSoft.bins[t];
+	for (size_t i = 0; i < bin->len; i++) {
+		const struct softQuad *const q = &gSoft.quads[bin->quads[i]];
+		const struct softTexture *const tex = &gSoft.textures[q->texnam];
+		const int x0 = q->x0 > tx0 ? q->x0 : tx0, x1 = q->x1 < tx1 ? q->x1 : tx1;
+		const int y0 = q->y0 > ty0 ? q->y0 : ty0, y1 = q->y1 < ty1 ? q->y1 : ty1;
+		const int64_t u = q->u0 + (x0 - q->x0) * q->du;
+		for (int y = y0; y < y1; y++) {
+			const int v = clampTexel(q->v0 + (y - q->y0) * q->dv, tex->height);
+			drawSpan(&gSoft.fb[y * SOFT_WIDTH + x0], x1 - x0,
+				&tex->texels[(size_t)v * tex->width], tex->width, u, q->du,
+				tex->hasAlpha);
+		}
+	}
+}
+
+// Take screen tiles until there are none left.
+static void drawTiles(void) {
+	for (int t; (t = atomic_fetch_add(&gSoft.nextTile, 1)) < SOFT_NTILES;)
+		drawTile(t);
+}
+
+static int softWorker(void *p) {
+	assert(!p);
+	uint64_t frame = 0;
+	for (;;) {
+		mutexLock(&gSoft.mtx);
+		while (gSoft.frame == frame && !gSoft.quit)
+			cnd_wait(&gSoft.start, &gSoft.mtx);
+		if (gSoft.quit) {
+			mutexUnlock(&gSoft.mtx);
+			return 0;
+		}
+		frame = gSoft.frame;
+		mutexUnlock(&gSoft.mtx);
+
+		drawTiles();
+
+		mutexLock(&gSoft.mtx);
+		if (--gSoft.working == 0)
+			cnd_signal(&gSoft.done);
+		mutexUnlock(&gSoft.mtx);
+	}
+}
+
+// Draw everything queued since softClear() into the framebuffer.
+static int softFinishFrame(void) {
+	atomic_store(&gSoft.nextTile, 0);
+	mutexLock(&gSoft.mtx);
+	gSoft.frame++;
+	gSoft.working = gSoft.nThreads;
+	cnd_broadcast(&gSoft.start);
+	mutexUnlock(&gSoft.mtx);
+
+	drawTiles();
+
+	mutexLock(&gSoft.mtx);
+	while (gSoft.working > 0)
+		cnd_wait(&gSoft.done, &gSoft.mtx);
+	mutexUnlock(&gSoft.mtx);
+	return 0;
+}
+
+const uint32_t *softFramebuffer(void) {
+	return gSoft.fb;
+}
+
+// Start the worker threads: STL_PLAYER_SOFT_THREADS, or one per CPU (the
+// thread drawing the frame is one of them).
+static void softInit(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *const threads = getenv("STL_PLAYER_SOFT_THREADS");
+	if (threads && atoi(threads) > 0)
+		n = atoi(threads);
+	if (n < 1)
+		n = 1;
+	if (n > SOFT_MAX_THREADS)
+		n = SOFT_MAX_THREADS;
+	gSoft.nThreads = n - 1;
+	fprintf(stderr, "DEBUG: software renderer, %ld threads\n", n);
+
+	must(thrd_success == mtx_init(&gSoft.mtx, mtx_plain));
+	must(thrd_success == cnd_init(&gSoft.start));
+	must(thrd_success == cnd_init(&gSoft.done));
+	for (int i = 0; i < gSoft.nThreads; i++)
+		must(thrd_success == thrd_create(&gSoft.threads[i], softWorker, NULL));
+	softClear(0xff000000);
+}
+
+static void softTerminate(void) {
+	mutexLock(&gSoft.mtx);
+	gSoft.quit = true;
+	cnd_broadcast(&gSoft.start);
+	mutexUnlock(&gSoft.mtx);
+	for (int i = 0; i < gSoft.nThreads; i++)
+		must(thrd_success == thrd_join(gSoft.threads[i], NULL));
+
+	for (size_t i = 0; i < gSoft.nTextures; i++)
+		free(gSoft.textures[i].texels);
+	free(gSoft.textures);
+	for (int i = 0; i < SOFT_NTILES; i++)
+		free(gSoft.bins[i].quads);
+	free(gSoft.quads);
+}
+
+const struct quadRenderer gSoftRenderer = {
+	.init = softInit,
+	.terminate = softTerminate,
+	.genTexture = softGenTexture,
+	.texImage = softTexImage,
+	.viewport = NULL,  // always 640x480; scaling is up to whoever presents it
+	.clear = softClear,
+	.queueQuads = softQueueQuads,
+	.finishFrame = softFinishFrame,
+};
@@ -1,10 +1,15 @@
 // stlplayer.c
 
 #include "stlplayer.h"
+#ifndef MACOSX
+#include "gltrace.h"
+#include <execinfo.h>  // backtrace(), for glDebugCallback()
+#endif
 
 static const int gWindowWidth = 640, gWindowHeight = 480;
 static const int TILE_WIDTH = 32, TILE_HEIGHT = 32;
 static int gScrollOffset = 0, gCurrLevel = 1, gNDeaths = 0;
+static int gPrevScrollOffset;  // gScrollOffset when the tick began
 
 typedef int Direction;
 enum { LEFT, RIGHT, UP, DOWN,
@@ -61,8 +66,7 @@ enum gOTNi {
 };
 static uint32_t gObjTextureNames[gOTNlen];  // shared across all levels
 
-static void initGLTextureNam(const uint32_t texnam, const char *const imgnam,
-	bool mirror, bool hasAlpha);
+static void setInteractiveTile(const int h, const int w, const uint8_t tileID);
 
 static WorldItem *worldItem_new(enum stl_obj_type type, int x, int y, int wi,
 	int h, float spx, float spy, bool gravity, void(*frame)(WorldItem *const),
@@ -70,8 +74,8 @@ static WorldItem *worldItem_new(enum stl_obj_type type, int x, int y, int wi,
 	assert(wi > 0 && h > 0 && wi < BUCKETS_SIZE);
 	WorldItem *w = nnmalloc(sizeof(WorldItem));
 	w->type = type;
-	w->x = x;
-	w->y = y;
+	w->x = w->prevX = x;
+	w->y = w->prevY = y;
 	w->width = wi;
 	w->height = h;
 	w->speedX = spx;
@@ -472,6 +476,10 @@ static void applyGravity() {
 		}
 }
 
+// softrender.c or gl33render.c, drawing instead of the GLES2 path; or NULL
+static const struct quadRenderer *gQuads = NULL;
+static bool gTexLoader;  // texloader.c uploads the level backgrounds
+
 // Opposite of initialize().
 void terminate(void) {
 	for (size_t i = 0; i < gBuckets_len; i++)
@@ -483,11 +491,463 @@ void terminate(void) {
 	memset(gBuckets, 0xe4, gBuckets_len * sizeof(WorldItem *));  // debug
 	free(gBuckets);
 	lrFailCleanup(NULL, &lvl);
+#ifndef MACOSX
+	if (gQuads)
+		gQuads->terminate();
+	if (gTexLoader)
+		texLoaderStop();
+#endif
 }
 
 static uint32_t prgm;
-static uint32_t vtx_shdr;
-static uint32_t frag_shdr;
+// prgm with ALPHA_TEST defined. Only drawing with it pays for the discard:
+// with it in every draw, llvmpipe took 40% longer a frame.
+static uint32_t gCutoutPrgm;
+
+// The "scroll" uniform of the vertex shader, in prgm and in gCutoutPrgm
+static int gScrollLoc[2] = { -1, -1 };
+
+// Per-frame rendering counters, printed (and reset) by printRenderStats().
+struct renderStats {
+	uint64_t frames, drawCalls, quads;
+	uint64_t glCalls, glCallsSkipped;  // state changes, uploads and draws
+	uint64_t chunksBuilt;  // tilemap chunks drawn into their textures
+	uint64_t messagesBuilt;  // messages drawn into gMessage
+	uint64_t itemsVisited, itemsDrawn;  // by the snapshots' culling
+	int64_t submit_ns;
+};
+static struct renderStats gRenderStats;
+
+// What the GL currently has bound/enabled, as far as the gls*() functions
+// know. All binds in this file must go through them or the cache goes stale.
+// ~0 (or -1) means unknown, so the first call always reaches the GL.
+struct glState {
+	uint32_t texture, program, arrayBuffer, elementArrayBuffer, framebuffer;
+	uint32_t attribBuffer;  // the buffer the attrib 0 pointer was set with
+	const void *attribOffset;
+	int8_t attribEnabled, blend, blendFunc, depthTest, depthMask;
+	float scroll[2][2];  // prgm's, then gCutoutPrgm's
+	float depth;  // of everything drawn; see glsDepth()
+	int viewport[4];
+};
+static struct glState gGLState = {
+	.texture = ~0u, .program = ~0u, .arrayBuffer = ~0u,
+	.elementArrayBuffer = ~0u, .framebuffer = ~0u, .attribBuffer = ~0u,
+	.attribEnabled = -1,
+	.blend = -1, .blendFunc = -1, .depthTest = -1, .depthMask = -1,
+	.scroll = { { -1, -1 }, { -1, -1 } }, .depth = -1,
+	.viewport = { -1, -1, -1, -1 },
+};
+
+// Count a GL call that had to be issued (true) or could be skipped (false).
+static bool glsCount(bool issue) {
+	if (issue)
+		gRenderStats.glCalls++;
+	else
+		gRenderStats.glCallsSkipped++;
+	return issue;
+}
+
+// Issue a GL call that the cache doesn't track, and count it.
+#define GLS(call) (glsCount(true), (call))
+
+static void glsBindTexture(const uint32_t texnam) {
+	if (glsCount(gGLState.texture != texnam)) {
+		gGLState.texture = texnam;
+		glBindTexture(GL_TEXTURE_2D, texnam);
+	}
+}
+
+static void glsUseProgram(const uint32_t program) {
+	if (glsCount(gGLState.program != program)) {
+		gGLState.program = program;
+		glUseProgram(program);
+	}
+}
+
+#ifndef MACOSX
+static void glsBindFramebuffer(const uint32_t fbo) {
+	if (glsCount(gGLState.framebuffer != fbo)) {
+		gGLState.framebuffer = fbo;
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	}
+}
+#endif
+
+static void glsBindBuffer(const uint32_t target, const uint32_t buf) {
+	uint32_t *const bound = target == GL_ARRAY_BUFFER ?
+		&gGLState.arrayBuffer : &gGLState.elementArrayBuffer;
+	if (glsCount(*bound != buf)) {
+		*bound = buf;
+		glBindBuffer(target, buf);
+	}
+}
+
+// Point (and enable) attrib 0 at offset into the bound GL_ARRAY_BUFFER.
+static void glsVertexAttribPointer(const void *const offset) {
+	if (glsCount(gGLState.attribBuffer != gGLState.arrayBuffer ||
+		gGLState.attribOffset != offset)) {
+		gGLState.attribBuffer = gGLState.arrayBuffer;
+		gGLState.attribOffset = offset;
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, offset);
+	}
+	if (glsCount(gGLState.attribEnabled != 1)) {
+		gGLState.attribEnabled = 1;
+		glEnableVertexAttribArray(0);
+	}
+}
+
+static void glsBlend(const bool enable) {
+	if (glsCount(gGLState.blend != enable)) {
+		gGLState.blend = enable;
+		if (enable)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+	}
+}
+
+#ifndef MACOSX
+// How blending combines a texel with what is under it: straight alpha over it,
+// premultiplied alpha over it, or (for drawing into a transparent texture that
+// is drawn premultiplied later) straight alpha over it, keeping the coverage.
+enum blendFunc { BLEND_OVER, BLEND_PREMULTIPLIED, BLEND_ACCUMULATE };
+
+static void glsBlendFunc(const enum blendFunc func) {
+	if (glsCount(gGLState.blendFunc != (int8_t)func)) {
+		gGLState.blendFunc = func;
+		if (func == BLEND_ACCUMULATE)
+			glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE,
+				GL_ONE_MINUS_SRC_ALPHA);
+		else
+			glBlendFunc(func == BLEND_OVER ? GL_SRC_ALPHA : GL_ONE,
+				GL_ONE_MINUS_SRC_ALPHA);
+	}
+}
+#endif
+
+static void glsDepthTest(const bool enable) {
+	if (glsCount(gGLState.depthTest != enable)) {
+		gGLState.depthTest = enable;
+		if (enable)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+	}
+}
+
+static void glsDepthMask(const bool enable) {
+	if (glsCount(gGLState.depthMask != enable)) {
+		gGLState.depthMask = enable;
+		glDepthMask(enable);
+	}
+}
+
+// Give everything drawn from now on depth z. The shaders draw at z = 0, so a
+// depth range of [z, z] is enough.
+static void glsDepth(const float z) {
+	if (glsCount(gGLState.depth != z)) {
+		gGLState.depth = z;
+#ifdef MACOSX
+		glDepthRange(z, z);
+#else
+		glDepthRangef(z, z);
+#endif
+	}
+}
+
+// Set the scroll of the program in use (each program has its own).
+static void glsScroll(const float x, const float y) {
+	const int p = gGLState.program == gCutoutPrgm;
+	if (glsCount(gGLState.scroll[p][0] != x || gGLState.scroll[p][1] != y)) {
+		gGLState.scroll[p][0] = x;
+		gGLState.scroll[p][1] = y;
+		glUniform2f(gScrollLoc[p], x, y);
+	}
+}
+
+// How a texture's texels cover what is under them. Opaque and cutout textures
+// are drawn without blending (cutouts with gCutoutPrgm, which discards their
+// transparent texels); translucent ones are blended. Higher is cheaper, so the
+// kind of a set of textures is the lowest of theirs.
+enum texKind { TEX_TRANSLUCENT, TEX_CUTOUT, TEX_OPAQUE };
+static uint8_t *gTexKinds;  // indexed by texnam; 0 (TEX_TRANSLUCENT) if unknown
+static size_t gTexKinds_len;
+
+static void setTexKind(const uint32_t texnam, const enum texKind kind) {
+	if (texnam >= gTexKinds_len) {
+		const size_t len = texnam + 256;
+		gTexKinds = nnrealloc(gTexKinds, len);
+		memset(gTexKinds + gTexKinds_len, TEX_TRANSLUCENT, len - gTexKinds_len);
+		gTexKinds_len = len;
+	}
+	gTexKinds[texnam] = kind;
+}
+
+static enum texKind texKind(const uint32_t texnam) {
+	return texnam < gTexKinds_len ? gTexKinds[texnam] : TEX_TRANSLUCENT;
+}
+
+// The kind of an image of n RGBA (or, without hasAlpha, RGB) texels.
+static enum texKind imgKind(const char *const img, const size_t n,
+	const bool hasAlpha) {
+	if (!hasAlpha)
+		return TEX_OPAQUE;
+	enum texKind kind = TEX_OPAQUE;
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t a = img[i * 4 + 3];
+		if (a != 0 && a != 0xff)
+			return TEX_TRANSLUCENT;
+		if (a == 0)
+			kind = TEX_CUTOUT;
+	}
+	return kind;
+}
+
+// Set the blending and program for drawing textures of a kind. Call it before
+// glsScroll().
+static void glsTexKind(const enum texKind kind) {
+	glsBlend(kind == TEX_TRANSLUCENT);
+	glsUseProgram(kind == TEX_CUTOUT ? gCutoutPrgm : prgm);
+}
+
+static void glsViewport(const int x, const int y, const int w, const int h) {
+	const int v[4] = { x, y, w, h };
+	if (glsCount(memcmp(gGLState.viewport, v, sizeof(v)) != 0)) {
+		memcpy(gGLState.viewport, v, sizeof(v));
+		glViewport(x, y, w, h);
+	}
+}
+
+// Draw nQuads quads of the bound buffers, starting at quad first.
+static void glsDrawQuads(const size_t first, const size_t nQuads) {
+	GLS(glDrawElements(GL_TRIANGLES, nQuads * 6, GL_UNSIGNED_SHORT,
+		(const void *)(first * 6 * sizeof(uint16_t))));
+	gRenderStats.drawCalls++;
+}
+
+// glGenTextures(), or the quad renderer's equivalent.
+static void genTextures(const int n, uint32_t *const texnams) {
+#ifndef MACOSX
+	if (gQuads) {
+		for (int i = 0; i < n; i++)
+			texnams[i] = gQuads->genTexture();
+		return;
+	}
+#endif
+	glGenTextures(n, texnams);
+}
+
+// The formats the GLES2 path can upload a texture in, cheapest first. Each
+// texture gets the first one that keeps every channel of every texel within
+// gTexError of its 8-bit value. (The colour of a texel with alpha 0 never
+// shows, as only the opaque background is filtered.) A 5-bit channel is never
+// more than 4 off, so the default lets every opaque image be RGB565 and every
+// cutout RGBA5551; it only keeps out LA88 for images that are not grey and
+// RGBA4444. 3 or less keeps the 5-bit formats out too.
+enum texFormat { TF_LA88, TF_RGB565, TF_RGBA5551, TF_RGBA4444, TF_RGB888,
+	TF_RGBA8888, NTEXFORMATS };
+static const struct {
+	GLenum format, type;
+	int bits[4];  // of r, g, b and a; 0 for none. LA88 keeps (r + g + b) / 3.
+	int bytes;  // per texel
+	const char *name;
+} kTexFormats[NTEXFORMATS] = {
+	{ GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, { 8, 8, 8, 8 }, 2, "LA88" },
+	{ GL_RGB, GL_UNSIGNED_SHORT_5_6_5, { 5, 6, 5, 0 }, 2, "RGB565" },
+	{ GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, { 5, 5, 5, 1 }, 2, "RGBA5551" },
+	{ GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, { 4, 4, 4, 4 }, 2, "RGBA4444" },
+	{ GL_RGB, GL_UNSIGNED_BYTE, { 8, 8, 8, 0 }, 3, "RGB888" },
+	{ GL_RGBA, GL_UNSIGNED_BYTE, { 8, 8, 8, 8 }, 4, "RGBA8888" },
+};
+static int gTexError = 4;  // STL_PLAYER_TEX_ERROR
+
+// The bits most significant bits of 8-bit channel c, rounded.
+static int quantize(const int c, const int bits) {
+	const int max = (1 << bits) - 1;
+	return (c * max + 127) / 255;
+}
+
+// c as the GL reads it back from bits bits; 255 for a missing alpha. Mesa
+// widens a channel by repeating its bits, which rounds a little differently
+// from scaling by 255 / max, and the tile atlas has to match it exactly.
+static int requantize(const int c, const int bits) {
+	if (bits == 0)
+		return 255;
+	int q = quantize(c, bits) << (8 - bits);
+	for (int b = bits; b < 8; b += bits)
+		q |= q >> bits;
+	return q;
+}
+
+// The cheapest format for n texels of img (RGBA, or RGB without hasAlpha)
+// that keeps them within maxError.
+static enum texFormat pickTexFormat(const char *const img, const size_t n,
+	const bool hasAlpha, const int maxError) {
+	int err[NTEXFORMATS] = { 0 };
+	const int texelSize = hasAlpha ? 4 : 3;
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *const t = (const uint8_t *)img + i * texelSize;
+		const int a = hasAlpha ? t[3] : 255;
+		const int l = (t[0] + t[1] + t[2] + 1) / 3;
+		for (int f = 0; f < NTEXFORMATS; f++) {
+			int e = abs(a - requantize(a, kTexFormats[f].bits[3]));
+			for (int c = 0; c < 3 && a; c++) {
+				const int back = f == TF_LA88 ? l :
+					requantize(t[c], kTexFormats[f].bits[c]);
+				if (abs(t[c] - back) > e)
+					e = abs(t[c] - back);
+			}
+			if (e > err[f])
+				err[f] = e;
+		}
+	}
+	for (int f = 0; f < NTEXFORMATS; f++)
+		if (err[f] <= maxError)
+			return f;
+	return TF_RGBA8888;
+}
+
+// img's n texels in format f. Returns NULL if img already is.
+static char *packTexels(const char *const img, const size_t n,
+	const bool hasAlpha, const enum texFormat f) {
+	if ((f == TF_RGB888 && !hasAlpha) || (f == TF_RGBA8888 && hasAlpha))
+		return NULL;
+	const int texelSize = hasAlpha ? 4 : 3;
+	const int *const bits = kTexFormats[f].bits;
+	char *const rv = nnmalloc(n * kTexFormats[f].bytes);
+	for (size_t i = 0; i < n; i++) {
+		const uint8_t *const t = (const uint8_t *)img + i * texelSize;
+		const int a = hasAlpha ? t[3] : 255;
+		uint8_t *const out = (uint8_t *)rv + i * kTexFormats[f].bytes;
+		if (f == TF_LA88) {
+			out[0] = (t[0] + t[1] + t[2] + 1) / 3;
+			out[1] = a;
+		} else if (kTexFormats[f].bytes == 2) {  // packed, r in the top bits
+			uint16_t v = 0;
+			for (int c = 0; c < 4; c++)
+				if (bits[c])
+					v = v << bits[c] | quantize(c < 3 ? t[c] : a, bits[c]);
+			memcpy(out, &v, 2);
+		} else {
+			memcpy(out, t, 3);
+			if (f == TF_RGBA8888)
+				out[3] = a;
+		}
+	}
+	return rv;
+}
+
+// Texture memory of the images the GLES2 path draws from, and what it would
+// be with them all uploaded as their files' 8-bit RGB or RGBA. With the static
+// tilemaps the tiles are drawn from gTileAtlas, so the tile textures it holds
+// are left out; without, the atlas is.
+static struct {
+	size_t bytes, bytes8;
+	int textures[NTEXFORMATS];
+} gTexMemory;
+
+// Count (or, with sign -1, uncount) an image of n texels in format f.
+static void countTexMemory(const enum texFormat f, const size_t n,
+	const bool hasAlpha, const int sign) {
+	gTexMemory.bytes += sign * (ptrdiff_t)(n * kTexFormats[f].bytes);
+	gTexMemory.bytes8 += sign * (ptrdiff_t)(n * (hasAlpha ? 4 : 3));
+	gTexMemory.textures[f] += sign;
+}
+
+static void printTexMemory(void) {
+	fprintf(stderr, "DEBUG: textures take %.2f MB (%.2f MB as 8-bit RGB(A)):",
+		gTexMemory.bytes / 1e6, gTexMemory.bytes8 / 1e6);
+	for (int f = 0; f < NTEXFORMATS; f++)
+		fprintf(stderr, " %d %s", gTexMemory.textures[f], kTexFormats[f].name);
+	fprintf(stderr, "\n");
+}
+
+// glTexImage2D() of a w by h image (RGBA, or RGB without hasAlpha) to the bound
+// texture, in the cheapest format within maxError. Returns the format.
+static enum texFormat texImagePacked(const int w, const int h,
+	const char *const img, const bool hasAlpha, const int maxError) {
+	const size_t n = (size_t)w * h;
+	const enum texFormat f = pickTexFormat(img, n, hasAlpha, maxError);
+	char *const packed = packTexels(img, n, hasAlpha, f);
+	glTexImage2D(GL_TEXTURE_2D, 0, kTexFormats[f].format, w, h, 0,
+		kTexFormats[f].format, kTexFormats[f].type, packed ? packed : img);
+	free(packed);
+	return f;
+}
+
+// GL errors. Debug builds have GL_KHR_debug report an error from inside the
+// call that made it, with a backtrace, and abort; without the extension,
+// glCheck() looks for errors wherever it is placed (once per frame in
+// drawSnapshot()), and names that place. Release builds (NDEBUG) never call
+// glGetError().
+#ifdef NDEBUG
+#define glCheck() ((void)0)
+#else
+#define glCheck() glCheckAt(__func__, __LINE__)
+static bool gGLDebugOutput;  // errors go to glDebugCallback()
+
+static void glCheckAt(const char *const func, const int line) {
+	if (gQuads || gGLDebugOutput)
+		return;
+	const GLenum err = glGetError();
+	if (err == GL_NO_ERROR)
+		return;
+	fprintf(stderr, "ERROR: GL error 0x%x, found in %s() at line %d\n", err,
+		func, line);
+	abort();
+}
+
+#ifndef MACOSX
+static void GL_APIENTRY glDebugCallback(GLenum source, GLenum type, GLuint id,
+	GLenum severity, GLsizei length, const GLchar *message,
+	const void *userParam) {
+	(void)source, (void)id, (void)length, (void)userParam;
+	if (type != GL_DEBUG_TYPE_ERROR_KHR &&
+		severity != GL_DEBUG_SEVERITY_HIGH_KHR)
+		return;
+	fprintf(stderr, "ERROR: GL: %s\n", message);
+	void *stack[16];  // resolve with addr2line -f -e stl_player
+	backtrace_symbols_fd(stack, backtrace(stack, 16), STDERR_FILENO);
+	if (type == GL_DEBUG_TYPE_ERROR_KHR)
+		abort();
+}
+
+// Route GL errors to glDebugCallback(), if the GL has GL_KHR_debug. Its
+// output is synchronous, so the backtrace has the call that failed.
+static void initialize_gl_debug(void) {
+	const char *const exts = (const char *)glGetString(GL_EXTENSIONS);
+	const PFNGLDEBUGMESSAGECALLBACKKHRPROC debugMessageCallback =
+		(PFNGLDEBUGMESSAGECALLBACKKHRPROC)eglGetProcAddress(
+		"glDebugMessageCallbackKHR");
+	if (!exts || !strstr(exts, "GL_KHR_debug") || !debugMessageCallback) {
+		fprintf(stderr, "DEBUG: no GL_KHR_debug; checking for GL errors once "
+			"per frame\n");
+		return;
+	}
+	debugMessageCallback(glDebugCallback, NULL);
+	glEnable(GL_DEBUG_OUTPUT_KHR);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+	gGLDebugOutput = true;
+	fprintf(stderr, "DEBUG: GL errors reported through GL_KHR_debug\n");
+}
+#endif
+#endif
+
+// Around GL calls whose errors are handled (e.g. a rejected program binary),
+// so that glDebugCallback() doesn't take them for bugs.
+static void expectGLErrors(const bool expect) {
+#if !defined(NDEBUG) && !defined(MACOSX)
+	if (!gGLDebugOutput)
+		return;
+	if (expect)
+		glDisable(GL_DEBUG_OUTPUT_KHR);
+	else
+		glEnable(GL_DEBUG_OUTPUT_KHR);
+#else
+	(void)expect;
+#endif
+}
 
 // Print shdr log.
 static void printShaderLog(uint32_t shdr) {
@@ -501,62 +961,194 @@ static void printShaderLog(uint32_t shdr) {
 	}
 }
 
-// Helper for initialize_prgm.
-static void populateShaders(void) {
-	const char *const kPathVtx = "shaders/vtx.txt";
-	const char *const kPathFrag = "shaders/frag.txt";
-	
-	ssize_t src_len;
-	
-	must(strlen(kPathVtx) + gSelf_len < 4096);
-	strcpy(gSelf + gSelf_len, kPathVtx);
-	
-	char *const vtx_src = safe_read(gSelf, &src_len);
-	glShaderSource(vtx_shdr, 1, (const char *const *)&vtx_src, (int *)&src_len);
-	free(vtx_src);
-	
-	must(strlen(kPathFrag) + gSelf_len < 4096);
-	strcpy(gSelf + gSelf_len, kPathFrag);
-	
-	char *const frag_src = safe_read(gSelf, &src_len);
-	glShaderSource(frag_shdr, 1, (const char *const *)&frag_src,
-		(int *)&src_len);
-	free(frag_src);
+// FNV-1a, continuing from hash.
+static uint64_t fnv1a(uint64_t hash, const void *const data, const size_t len) {
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ ((const uint8_t *)data)[i]) * 1099511628211ULL;
+	return hash;
+}
+
+#ifndef MACOSX
+// The linked program is cached with GL_OES_get_program_binary, in a file named
+// after a hash of the driver's strings and the shader sources (so a driver
+// update or a shader edit makes a new one). STL_PLAYER_NO_PROGRAM_CACHE=1
+// turns it off.
+static PFNGLGETPROGRAMBINARYOESPROC pglGetProgramBinaryOES;
+static PFNGLPROGRAMBINARYOESPROC pglProgramBinaryOES;
+
+// Fill in the cache file's path for these sources. Return false if there is
+// no program cache.
+static bool programCachePath(char *const path, const size_t size,
+	const char *const vtx_src, const char *const frag_src) {
+	if (getenv("STL_PLAYER_NO_PROGRAM_CACHE"))
+		return false;
+	const char *const exts = (const char *)glGetString(GL_EXTENSIONS);
+	int nFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &nFormats);
+	pglGetProgramBinaryOES = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress(
+		"glGetProgramBinaryOES");
+	pglProgramBinaryOES = (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress(
+		"glProgramBinaryOES");
+	if (!exts || !strstr(exts, "GL_OES_get_program_binary") || nFormats <= 0 ||
+		!pglGetProgramBinaryOES || !pglProgramBinaryOES)
+		return false;
 	
-	gSelf[gSelf_len] = '\0';  // replace the null terminator
+	const char *const strs[] = {
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION),
+		vtx_src, frag_src,
+	};
+	uint64_t key = 14695981039346656037ULL;
+	for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); i++)
+		if (strs[i])  // with the terminator, to keep the fields apart
+			key = fnv1a(key, strs[i], strlen(strs[i]) + 1);
+	char name[64];
+	snprintf(name, sizeof(name), "program-%016llx.bin",
+		(long long unsigned)key);
+	return cachePath(path, size, name);
 }
 
-// Initialize the GL program.
-static void initialize_prgm() {
-	prgm = glCreateProgram();
+// Load prgm from the cache file: the binary format, then the binary.
+static bool loadProgramBinary(const uint32_t prgm, const char *const path) {
+	ssize_t len;
+	char *const buf = safe_read(path, &len);
+	if (!buf)
+		return false;
+	int linked = 0;
+	uint32_t format;
+	expectGLErrors(true);
+	if ((size_t)len > sizeof(format)) {
+		memcpy(&format, buf, sizeof(format));
+		pglProgramBinaryOES(prgm, format, buf + sizeof(format),
+			len - sizeof(format));
+		glGetProgramiv(prgm, GL_LINK_STATUS, &linked);
+	}
+	free(buf);
+	glGetError();  // a stale binary is not an error; it just isn't used
+	expectGLErrors(false);
+	if (!linked)
+		fprintf(stderr, "DEBUG: cached program %s rejected\n", path);
+	return linked;
+}
+
+static void saveProgramBinary(const uint32_t prgm, const char *const path) {
+	int len = 0;
+	glGetProgramiv(prgm, GL_PROGRAM_BINARY_LENGTH_OES, &len);
+	if (len <= 0)
+		return;
+	char *const buf = nnmalloc(sizeof(uint32_t) + len);
+	uint32_t format;
+	pglGetProgramBinaryOES(prgm, len, NULL, &format, buf + sizeof(format));
+	memcpy(buf, &format, sizeof(format));
+	if (glGetError() != GL_NO_ERROR ||
+		!writeFileAtomically(path, buf, sizeof(format) + len))
+		fprintf(stderr, "DEBUG: couldn't cache the program in %s\n", path);
+	free(buf);
+}
+#endif
+
+// Print prgm's log, and die, if it did not link.
+static void checkProgram(const uint32_t prgm) {
+	int32_t linked = 0;
+	glGetProgramiv(prgm, GL_LINK_STATUS, &linked);
+	if (glGetError() == GL_NO_ERROR && linked)
+		return;
+	int32_t log_len;
+	glGetProgramiv(prgm, GL_INFO_LOG_LENGTH, &log_len);
+	if (log_len) {
+		char *log = nnmalloc(log_len);
+		glGetProgramInfoLog(prgm, log_len, NULL, log);
+		fprintf(stderr, "PRGM_LOG: %s\n", log);
+		free(log);
+	}
+	assert(NULL);
+}
+
+// Link a program from the shaders' sources, from the program cache if
+// possible. Add the time spent compiling and linking to *compile_ns and
+// *link_ns; they stay as they are if it came from the cache.
+static uint32_t linkProgram(const char *const vtx_src,
+	const char *const frag_src, int64_t *const compile_ns,
+	int64_t *const link_ns) {
+	const uint32_t prgm = glCreateProgram();
 	must(prgm);
-	vtx_shdr = glCreateShader(GL_VERTEX_SHADER);
-	frag_shdr = glCreateShader(GL_FRAGMENT_SHADER);
-	must(vtx_shdr && frag_shdr);
-	
-	populateShaders();
+#ifndef MACOSX
+	char cache[4096];
+	const bool useCache = programCachePath(cache, sizeof(cache), vtx_src,
+		frag_src);
+	if (useCache && loadProgramBinary(prgm, cache))
+		return prgm;
+#endif
 	
+	const uint32_t vtx_shdr = glCreateShader(GL_VERTEX_SHADER);
+	const uint32_t frag_shdr = glCreateShader(GL_FRAGMENT_SHADER);
+	must(vtx_shdr && frag_shdr);
+	glShaderSource(vtx_shdr, 1, &vtx_src, NULL);
+	glShaderSource(frag_shdr, 1, &frag_src, NULL);
 	glAttachShader(prgm, vtx_shdr);
 	glAttachShader(prgm, frag_shdr);
 	
+	const int64_t compileStart = monotonicNS();
 	glCompileShader(vtx_shdr);
 	glCompileShader(frag_shdr);
+	int compiled;  // (waits for the compiler, for the timing)
+	glGetShaderiv(frag_shdr, GL_COMPILE_STATUS, &compiled);
+	*compile_ns += monotonicNS() - compileStart;
 	printShaderLog(vtx_shdr);
 	printShaderLog(frag_shdr);
 	
+	glBindAttribLocation(prgm, 0, "verticesAndTexcoords");
+	const int64_t linkStart = monotonicNS();
 	glLinkProgram(prgm);
-	glUseProgram(prgm);
-	if (glGetError() != GL_NO_ERROR) {
-		int32_t log_len;
-		glGetProgramiv(prgm, GL_INFO_LOG_LENGTH, &log_len);
-		if (log_len) {
-			char *log = nnmalloc(log_len);
-			glGetProgramInfoLog(prgm, log_len, NULL, log);
-			fprintf(stderr, "PRGM_LOG: %s\n", log);
-			free(log);
-			assert(NULL);
-		}
-	}
+	checkProgram(prgm);
+	*link_ns += monotonicNS() - linkStart;
+	glDeleteShader(vtx_shdr);  // (only flagged; the program keeps them)
+	glDeleteShader(frag_shdr);
+#ifndef MACOSX
+	if (useCache)
+		saveProgramBinary(prgm, cache);
+#endif
+	return prgm;
+}
+
+// Initialize the GL programs: prgm, and gCutoutPrgm from the same sources with
+// ALPHA_TEST defined.
+static void initialize_prgm() {
+	const int64_t start = monotonicNS();
+	ssize_t vtx_len, frag_len;
+	char *const vtx_src = vfsRead("shaders/vtx.txt", &vtx_len);
+	char *const frag_src = vfsRead("shaders/frag.txt", &frag_len);
+	must(vtx_src && frag_src);
+	vtx_src[vtx_len] = frag_src[frag_len] = '\0';  // safe_read() leaves room
+	static const char kAlphaTest[] = "#define ALPHA_TEST 1\n";
+	char *const cutout_src = nnmalloc(sizeof(kAlphaTest) + frag_len);
+	memcpy(cutout_src, kAlphaTest, sizeof(kAlphaTest) - 1);
+	memcpy(cutout_src + sizeof(kAlphaTest) - 1, frag_src, frag_len + 1);
+	
+	int64_t compile_ns = 0, link_ns = 0;
+	prgm = linkProgram(vtx_src, frag_src, &compile_ns, &link_ns);
+	gCutoutPrgm = linkProgram(vtx_src, cutout_src, &compile_ns, &link_ns);
+#ifndef MACOSX
+	traceProgram(prgm, "verticesAndTexcoords", vtx_src, frag_src);
+	traceProgram(gCutoutPrgm, "verticesAndTexcoords", vtx_src, cutout_src);
+#endif
+	free(vtx_src);
+	free(frag_src);
+	free(cutout_src);
+	
+	gScrollLoc[0] = glGetUniformLocation(prgm, "scroll");
+	gScrollLoc[1] = glGetUniformLocation(gCutoutPrgm, "scroll");
+	glsUseProgram(prgm);
+	checkProgram(prgm);
+	checkProgram(gCutoutPrgm);
+	if (!compile_ns && !link_ns)
+		fprintf(stderr, "DEBUG: programs loaded from the cache in %.2f ms\n",
+			(monotonicNS() - start) / 1e6);
+	else
+		fprintf(stderr, "DEBUG: shaders compiled in %.2f ms, linked in "
+			"%.2f ms (%.2f ms in all)\n", compile_ns / 1e6, link_ns / 1e6,
+			(monotonicNS() - start) / 1e6);
 }
 
 // Callback for doing nothing.
@@ -835,8 +1427,8 @@ static void fnTux(WorldItem *self) {
 				if (colls[i]->state == 1 &&  // bonus is active
 					topOf(self) - 1 == bottomOf(colls[i])) {
 					colls[i]->state = 0;  // deactivate (b/c one use only)
-					lvl.interactivetm[y][x] = 84;
-					lvl.interactivetm[y - 1][x] = 44;
+					setInteractiveTile(y, x, 84);
+					setInteractiveTile(y - 1, x, 44);
 					addToBuckets(worldItem_new_block(
 						STL_COIN,
 						colls[i]->x,
@@ -845,7 +1437,7 @@ static void fnTux(WorldItem *self) {
 				} else if (colls[i]->state == 2 &&  // bonus egg
 					topOf(self) - 1 == bottomOf(colls[i])) {
 					colls[i]->state = 0;
-					lvl.interactivetm[y][x] = 84;
+					setInteractiveTile(y, x, 84);
 					WorldItem *snowball = worldItem_new_snowball(
 						colls[i]->x,
 						colls[i]->y - TILE_HEIGHT,
@@ -856,7 +1448,7 @@ static void fnTux(WorldItem *self) {
 				} else if (colls[i]->state == 3 &&  // bonus star
 					topOf(self) - 1 == bottomOf(colls[i])) {
 					colls[i]->state = 0;
-					lvl.interactivetm[y][x] = 84;
+					setInteractiveTile(y, x, 84);
 					WorldItem *bsnowball = worldItem_new_bsnowball(
 						colls[i]->x,
 						colls[i]->y - TILE_HEIGHT
@@ -866,7 +1458,7 @@ static void fnTux(WorldItem *self) {
 				} else if (colls[i]->state == 4 &&  // bonus 1up
 					topOf(self) - 1 == bottomOf(colls[i])) {
 					colls[i]->state = 0;
-					lvl.interactivetm[y][x] = 84;
+					setInteractiveTile(y, x, 84);
 					WorldItem *spiky = worldItem_new_spiky(
 						colls[i]->x,
 						colls[i]->y - TILE_HEIGHT,
@@ -885,7 +1477,7 @@ static void fnTux(WorldItem *self) {
 			case STL_COIN:
 				colls[i]->type = STL_DEAD;
 				//assert(lvl.interactivetm[y][x] == 44 || false);
-				lvl.interactivetm[y][x] = 0;
+				setInteractiveTile(y, x, 0);
 				break;
 			case STL_WIN:
 				fprintf(stderr, "You win!\n");
@@ -1048,7 +1640,7 @@ static void bombHandleExplosionCollisions(WorldItem *const self) {
 				coll->state = 0;  // destroy the bonus block
 				int x = (coll->x + gScrollOffset) / TILE_WIDTH;
 				int y = coll->y / TILE_HEIGHT;
-				lvl.interactivetm[y][x] = 84;
+				setInteractiveTile(y, x, 84);
 		}
 	}
 	free(colls);
@@ -1153,7 +1745,7 @@ static void applyFrame() {
 			} else if (w->next->type == STL_BRICK_DESTROYED) {
 				const int x = (w->next->x + gScrollOffset) / TILE_WIDTH;
 				const int y = w->next->y / TILE_HEIGHT;
-				lvl.interactivetm[y][x] = 0;
+				setInteractiveTile(y, x, 0);
 				delNodeAfter(w);
 			} else
 				w = w->next;
@@ -1194,89 +1786,225 @@ static void mirrorTexelImg(void *imgmem, bool hasAlpha) {
 		}
 }
 
-// Upload the file specified by imgnam to the texture specified by texnam to
-// make texnam usable by the GL.
-static void initGLTextureNam(const uint32_t texnam, const char *const imgnam,
-	bool mirror, bool hasAlpha) {
-	
-	must(gSelf_len + strlen(imgnam) < 4096);
-	strcpy(gSelf + gSelf_len, imgnam);
-	
-	ssize_t has_read;
-	char *imgmem = safe_read(gSelf, &has_read);
-	
-	gSelf[gSelf_len] = '\0';
-	
-	assert((!hasAlpha && has_read == 64 * 64 * 3) ||
-		(hasAlpha && has_read == 64 * 64 * 4));
+// Upload the texels in imgmem to the texture specified by texnam to make
+// texnam usable by the GL. Returns the format they were uploaded in.
+static enum texFormat uploadTexelImg(const uint32_t texnam, char *const imgmem,
+	const ssize_t imgmem_len, bool mirror, bool hasAlpha) {
+	assert((!hasAlpha && imgmem_len == 64 * 64 * 3) ||
+		(hasAlpha && imgmem_len == 64 * 64 * 4));
 	if (mirror) {  // flip-flop the image
 		mirrorTexelImg(imgmem, hasAlpha);
 	}
+	setTexKind(texnam, imgKind(imgmem, 64 * 64, hasAlpha));
+#ifndef MACOSX
+	if (gQuads) {
+		gQuads->texImage(texnam, 64, 64, imgmem, hasAlpha);
+		return hasAlpha ? TF_RGBA8888 : TF_RGB888;
+	}
+#endif
 	// Do NOT switch the active texture unit!
 	// See https://web.archive.org/web/20210905013830/https://users.cs.jmu.edu/b
 	//     ernstdh/web/common/lectures/summary_opengl-texture-mapping.php
 	//glActiveTexture(GL_TEXTURE0 + w->texunit);  bug
-	glBindTexture(GL_TEXTURE_2D, texnam);
+	glsBindTexture(texnam);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	int imgformat = GL_RGB;
-	if (hasAlpha)
-		imgformat = GL_RGBA;
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		imgformat,
-		64,
-		64,
-		0,
-		imgformat,
-		GL_UNSIGNED_BYTE,
-		imgmem
-	);
-	free(imgmem);
-	assert(glGetError() == GL_NO_ERROR);
+	const enum texFormat f = texImagePacked(64, 64, imgmem, hasAlpha,
+		gTexError);
+	glCheck();
+	return f;
+}
+
+// A texture file to upload to the GL, and where its texture name lives.
+struct texUpload {
+	uint32_t *texnam;
+	const char *imgnam;
+	bool mirror, hasAlpha;
+};
+typedef struct texUpload texUpload;
+
+// All of the tile textures in one texture, so that a whole tilemap layer can be
+// drawn with one draw call. The slot of a texture is the tileID it was loaded
+// for; slot 0 is opaque black (what an unloaded texture samples as).
+enum { ATLAS_SLOTS_PER_ROW = 16, ATLAS_SIZE = 64 * ATLAS_SLOTS_PER_ROW };
+static uint32_t gTileAtlas;
+static uint8_t gTileAtlasSlot[256];  // tileID -> slot in gTileAtlas
+static char *gTileAtlasImg;  // RGBA staging copy, only alive during startup
+static bool gStaticTilemaps = true;  // false: rebuild the tiles every frame
+
+// Helper for initGLTextureNams. Copy a tile texture into its atlas slot, as
+// the GL reads it back from format f, so that the atlas draws the same as the
+// tile's own texture. Return false if it has no slot.
+static bool stageAtlasTile(const texUpload *const upload,
+	const char *const imgmem, const enum texFormat f) {
+	const ptrdiff_t slot = upload->texnam - gTextureNames;
+	if (slot <= 0 || slot >= 256 || !imgmem)
+		return false;
+	const int texelSize = upload->hasAlpha ? 4 : 3;
+	const int *const bits = kTexFormats[f].bits;
+	const int col = slot % ATLAS_SLOTS_PER_ROW, row = slot / ATLAS_SLOTS_PER_ROW;
+	for (int y = 0; y < 64; y++)
+		for (int x = 0; x < 64; x++) {
+			const uint8_t *const src = (const uint8_t *)imgmem +
+				(y * 64 + x) * texelSize;
+			uint8_t *const dst = (uint8_t *)gTileAtlasImg +
+				((row * 64 + y) * ATLAS_SIZE + col * 64 + x) * 4;
+			const int l = (src[0] + src[1] + src[2] + 1) / 3;
+			for (int c = 0; c < 3; c++)
+				dst[c] = f == TF_LA88 ? l : requantize(src[c], bits[c]);
+			dst[3] = requantize(upload->hasAlpha ? src[3] : 0xff, bits[3]);
+		}
+	return true;
+}
+
+// The glyphs of on-screen messages, all in one texture: a-z, 0-9, FONT_COLS
+// to a row. (All grey, so it can be uploaded as LA88.) The red and green
+// backgrounds behind them are textures of their own, gMessageBgs.
+enum {
+	GLYPH_SIZE = 64, FONT_COLS = 8, FONT_ROWS = 5,
+	GLYPH_DIGITS = 26, GLYPH_RED = 36, GLYPH_GREEN = 37, NGLYPHS = 38,
+};
+static uint32_t gFontAtlas;
+static uint32_t gMessageBgs[2];  // GLYPH_RED's and GLYPH_GREEN's
+static char *gFontAtlasImg;  // RGBA staging copy, only alive during startup
+
+// Helper for initGLTextureNams. Copy glyph g into its place in the font atlas.
+static void stageFontGlyph(const int g, const char *const imgmem,
+	const ssize_t imgmem_len) {
+	assert(imgmem_len == GLYPH_SIZE * GLYPH_SIZE * 4);
+	const int col = g % FONT_COLS, row = g / FONT_COLS;
+	for (int y = 0; y < GLYPH_SIZE; y++)
+		memcpy(gFontAtlasImg + ((row * GLYPH_SIZE + y) * FONT_COLS * GLYPH_SIZE +
+			col * GLYPH_SIZE) * 4, imgmem + y * GLYPH_SIZE * 4, GLYPH_SIZE * 4);
+}
+
+// Read every file in uploads in a single batch, then upload them all. The
+// first nTiles uploads must be from kTileTextures; they are also staged into
+// the tile atlas. The last NGLYPHS must be gAlphaTextures, whose letters and
+// digits are only staged into the font atlas.
+static void initGLTextureNams(const texUpload *const uploads, const size_t n,
+	const size_t nTiles) {
+	asset *const assets = nnmalloc(n * sizeof(asset));
+	for (size_t i = 0; i < n; i++)
+		assets[i].path = uploads[i].imgnam;
+	char *const arena = readAssets(assets, n, ASSET_IO_DEFAULT);
+	
+	for (size_t i = 0; i < n; i++) {
+		if (i >= n - NGLYPHS && !uploads[i].texnam) {
+			stageFontGlyph(i - (n - NGLYPHS), assets[i].buf, assets[i].len);
+			continue;
+		}
+		const enum texFormat f = uploadTexelImg(*uploads[i].texnam,
+			assets[i].buf, assets[i].len, uploads[i].mirror, uploads[i].hasAlpha);
+		const bool inAtlas = i < nTiles &&
+			stageAtlasTile(&uploads[i], assets[i].buf, f);
+		if (!gQuads && !(inAtlas && gStaticTilemaps))  // see gTexMemory
+			countTexMemory(f, 64 * 64, uploads[i].hasAlpha, 1);
+	}
+	
+	free(arena);
+	free(assets);
 }
 
+// Tiles with a texture file of their own. (Aliases are set up separately.)
+// todo: connect the rest of the valid texturename indexes to files
+static const texUpload kTileTextures[] = {
+	{ &gTextureNames[7], "textures/snow1.data", false, true },
+	{ &gTextureNames[8], "textures/snow2.data", false, true },
+	{ &gTextureNames[9], "textures/snow3.data", false, true },
+	{ &gTextureNames[10], "textures/snow4.data", false, false },
+	{ &gTextureNames[11], "textures/snow5.data", false, false },
+	{ &gTextureNames[12], "textures/snow6.data", false, false },
+	{ &gTextureNames[13], "textures/snow7.data", false, false },
+	{ &gTextureNames[14], "textures/snow8.data", false, false },
+	{ &gTextureNames[15], "textures/snow9.data", false, false },
+	{ &gTextureNames[16], "textures/snow11.data", false, false },
+	{ &gTextureNames[19], "textures/snow13.data", false, false },
+	{ &gTextureNames[20], "textures/snow14.data", false, false },
+	{ &gTextureNames[21], "textures/snow15.data", false, false },
+	{ &gTextureNames[22], "textures/snow16.data", false, false },
+	{ &gTextureNames[23], "textures/snow17.data", false, false },
+	{ &gTextureNames[24], "textures/background7.data", false, true },
+	{ &gTextureNames[25], "textures/background8.data", false, true },
+	{ &gTextureNames[26], "textures/bonus2.data", false, true },
+	{ &gTextureNames[27], "textures/block1.data", false, true },
+	{ &gTextureNames[28], "textures/block2.data", false, true },
+	{ &gTextureNames[29], "textures/block3.data", false, true },
+	{ &gTextureNames[30], "textures/snow18.data", false, false },
+	{ &gTextureNames[31], "textures/snow19.data", false, false },
+	{ &gTextureNames[32], "textures/darksnow1.data", false, true },
+	{ &gTextureNames[36], "textures/darksnow5.data", false, true },
+	{ &gTextureNames[44], "textures/coin1.data", false, true },
+	{ &gTextureNames[47], "textures/block4.data", false, false },
+	{ &gTextureNames[48], "textures/block5.data", false, false },
+	{ &gTextureNames[49], "textures/block6.data", false, false },
+	{ &gTextureNames[50], "textures/block7.data", false, false },
+	{ &gTextureNames[51], "textures/block8.data", false, false },
+	{ &gTextureNames[52], "textures/block9.data", false, false },
+	{ &gTextureNames[53], "textures/pipe1.data", false, true },
+	{ &gTextureNames[54], "textures/pipe2.data", false, true },
+	{ &gTextureNames[55], "textures/pipe3.data", false, true },
+	{ &gTextureNames[56], "textures/pipe4.data", false, true },
+	{ &gTextureNames[57], "textures/pipe5.data", false, true },
+	{ &gTextureNames[58], "textures/pipe6.data", false, true },
+	{ &gTextureNames[59], "textures/pipe7.data", false, true },
+	{ &gTextureNames[60], "textures/pipe8.data", false, true },
+	{ &gTextureNames[61], "textures/block10.data", false, true },
+	{ &gTextureNames[64], "textures/grey.data", false, true },
+	{ &gTextureNames[75], "textures/water.data", false, true },
+	{ &gTextureNames[76], "textures/waves-1.data", false, true },
+	{ &gTextureNames[77], "textures/brick0.data", false, false },
+	{ &gTextureNames[78], "textures/brick1.data", false, false },
+	{ &gTextureNames[84], "textures/bonus2-d.data", false, true },
+	{ &gTextureNames[85], "textures/Acloud-00.data", false, true },
+	{ &gTextureNames[86], "textures/Acloud-01.data", false, true },
+	{ &gTextureNames[87], "textures/Acloud-02.data", false, true },
+	{ &gTextureNames[88], "textures/Acloud-03.data", false, true },
+	{ &gTextureNames[89], "textures/Acloud-10.data", false, true },
+	{ &gTextureNames[90], "textures/Acloud-11.data", false, true },
+	{ &gTextureNames[91], "textures/Acloud-12.data", false, true },
+	{ &gTextureNames[92], "textures/Acloud-13.data", false, true },
+	{ &gTextureNames[79], "textures/pole.data", false, true },
+	{ &gTextureNames[106], "textures/background1.data", false, true },
+	{ &gTextureNames[107], "textures/background2.data", false, true },
+	{ &gTextureNames[108], "textures/background3.data", false, true },
+	{ &gTextureNames[109], "textures/background4.data", false, true },
+	{ &gTextureNames[110], "textures/background5.data", false, true },
+	{ &gTextureNames[111], "textures/background6.data", false, true },
+	{ &gTextureNames[112], "textures/transparent2.data", false, true },
+	{ &gTextureNames[113], "textures/snow20.data", false, false },
+	{ &gTextureNames[114], "textures/snow21.data", false, false },
+	{ &gTextureNames[122], "textures/snowbg1.data", false, true },
+	{ &gTextureNames[123], "textures/snowbg2.data", false, true },
+	{ &gTextureNames[124], "textures/snowbg3.data", false, true },
+	{ &gTextureNames[125], "textures/snowbg4.data", false, true },
+	{ &gTextureNames[129], "textures/goal1.data", false, true },
+	{ &gTextureNames[130], "textures/goal2.data", false, true },
+	{ &gTextureNames[132], "textures/finalgoal.data", false, true },
+	{ &gTextureNames[136], "textures/run1.data", false, true },
+	{ &gTextureNames[137], "textures/run2.data", false, true },
+	{ &gTextureNames[138], "textures/run3.data", false, true },
+	{ &gTextureNames[139], "textures/run4.data", false, true },
+	{ &gTextureNames[200], "textures/water-trans.data", false, true },
+	{ &gTextureNames[201], "textures/waves-trans.data", false, true },
+	{ &gTextureNames[257], "textures/transparent.data", false, true },
+};
+
 static void maybeInitgTextureNames() {
 	static bool ran = false;
 	assert(!ran);
 	ran = true;
 	
-	glGenTextures(258, gTextureNames);
-	assert(glGetError() == GL_NO_ERROR);
-	
-	// todo: connect the rest of the valid texturename indexes to files
-	initGLTextureNam(gTextureNames[7], "textures/snow1.data", false, true);
-	initGLTextureNam(gTextureNames[8], "textures/snow2.data", false, true);
-	initGLTextureNam(gTextureNames[9], "textures/snow3.data", false, true);
-	initGLTextureNam(gTextureNames[10], "textures/snow4.data", false, false);
-	initGLTextureNam(gTextureNames[11], "textures/snow5.data", false, false);
-	initGLTextureNam(gTextureNames[12], "textures/snow6.data", false, false);
-	initGLTextureNam(gTextureNames[13], "textures/snow7.data", false, false);
-	initGLTextureNam(gTextureNames[14], "textures/snow8.data", false, false);
-	initGLTextureNam(gTextureNames[15], "textures/snow9.data", false, false);
-	initGLTextureNam(gTextureNames[16], "textures/snow11.data", false, false);
+	genTextures(258, gTextureNames);
+	glCheck();
+	
+	// Tiles that share a texture with another tile.
 	gTextureNames[17] = gTextureNames[16];
 	gTextureNames[18] = gTextureNames[16];
-	initGLTextureNam(gTextureNames[19], "textures/snow13.data", false, false);
-	initGLTextureNam(gTextureNames[20], "textures/snow14.data", false, false);
-	initGLTextureNam(gTextureNames[21], "textures/snow15.data", false, false);
-	initGLTextureNam(gTextureNames[22], "textures/snow16.data", false, false);
-	initGLTextureNam(gTextureNames[23], "textures/snow17.data", false, false);
-	initGLTextureNam(gTextureNames[24], "textures/background7.data", false, true);
-	initGLTextureNam(gTextureNames[25], "textures/background8.data", false, true);
-	initGLTextureNam(gTextureNames[26], "textures/bonus2.data", false, true);
-	initGLTextureNam(gTextureNames[27], "textures/block1.data", false, true);
-	initGLTextureNam(gTextureNames[28], "textures/block2.data", false, true);
-	initGLTextureNam(gTextureNames[29], "textures/block3.data", false, true);
-	initGLTextureNam(gTextureNames[30], "textures/snow18.data", false, false);
-	initGLTextureNam(gTextureNames[31], "textures/snow19.data", false, false);
-	initGLTextureNam(gTextureNames[32], "textures/darksnow1.data", false, true);
 	gTextureNames[33] = gTextureNames[32];
 	gTextureNames[34] = gTextureNames[32];
-	initGLTextureNam(gTextureNames[36], "textures/darksnow5.data", false, true);
 	gTextureNames[35] = gTextureNames[36];
 	gTextureNames[37] = gTextureNames[36];
 	gTextureNames[38] = gTextureNames[36];
@@ -1285,97 +2013,55 @@ static void maybeInitgTextureNames() {
 	gTextureNames[41] = gTextureNames[36];
 	gTextureNames[42] = gTextureNames[36];
 	gTextureNames[43] = gTextureNames[36];
-	initGLTextureNam(gTextureNames[44], "textures/coin1.data", false, true);
 	gTextureNames[45] = gTextureNames[44];
 	gTextureNames[46] = gTextureNames[44];
-	initGLTextureNam(gTextureNames[47], "textures/block4.data", false, false);
-	initGLTextureNam(gTextureNames[48], "textures/block5.data", false, false);
-	
-	initGLTextureNam(gTextureNames[49], "textures/block6.data", false, false);
-	initGLTextureNam(gTextureNames[50], "textures/block7.data", false, false);
-	initGLTextureNam(gTextureNames[51], "textures/block8.data", false, false);
-	initGLTextureNam(gTextureNames[52], "textures/block9.data", false, false);
-	
-	initGLTextureNam(gTextureNames[53], "textures/pipe1.data", false, true);
-	initGLTextureNam(gTextureNames[54], "textures/pipe2.data", false, true);
-	initGLTextureNam(gTextureNames[55], "textures/pipe3.data", false, true);
-	initGLTextureNam(gTextureNames[56], "textures/pipe4.data", false, true);
-	
-	initGLTextureNam(gTextureNames[57], "textures/pipe5.data", false, true);
-	initGLTextureNam(gTextureNames[58], "textures/pipe6.data", false, true);
-	initGLTextureNam(gTextureNames[59], "textures/pipe7.data", false, true);
-	initGLTextureNam(gTextureNames[60], "textures/pipe8.data", false, true);
-	initGLTextureNam(gTextureNames[61], "textures/block10.data", false, true);
+
 	gTextureNames[62] = gTextureNames[61];
-	
-	initGLTextureNam(gTextureNames[64], "textures/grey.data", false, true);
+
 	gTextureNames[65] = gTextureNames[64];
 	gTextureNames[66] = gTextureNames[64];
 	gTextureNames[67] = gTextureNames[64];
 	gTextureNames[68] = gTextureNames[64];
 	gTextureNames[69] = gTextureNames[64];
-	
-	initGLTextureNam(gTextureNames[75], "textures/water.data", false, true);
-	
-	initGLTextureNam(gTextureNames[76], "textures/waves-1.data", false, true);
-	initGLTextureNam(gTextureNames[77], "textures/brick0.data", false, false);
-	initGLTextureNam(gTextureNames[78], "textures/brick1.data", false, false);
+
 	gTextureNames[83] = gTextureNames[26];
-	initGLTextureNam(gTextureNames[84], "textures/bonus2-d.data", false, true);
-	initGLTextureNam(gTextureNames[85], "textures/Acloud-00.data", false, true);
-	initGLTextureNam(gTextureNames[86], "textures/Acloud-01.data", false, true);
-	initGLTextureNam(gTextureNames[87], "textures/Acloud-02.data", false, true);
-	initGLTextureNam(gTextureNames[88], "textures/Acloud-03.data", false, true);
-	initGLTextureNam(gTextureNames[89], "textures/Acloud-10.data", false, true);
-	initGLTextureNam(gTextureNames[90], "textures/Acloud-11.data", false, true);
-	initGLTextureNam(gTextureNames[91], "textures/Acloud-12.data", false, true);
-	initGLTextureNam(gTextureNames[92], "textures/Acloud-13.data", false, true);
 	gTextureNames[102] = gTextureNames[26];  // bonus egg
 	gTextureNames[103] = gTextureNames[26];  // bonus star
 	gTextureNames[104] = gTextureNames[77];
 	gTextureNames[105] = gTextureNames[78];
-	initGLTextureNam(gTextureNames[79], "textures/pole.data", false, true);
-	initGLTextureNam(gTextureNames[106], "textures/background1.data", false, true);
-	initGLTextureNam(gTextureNames[107], "textures/background2.data", false, true);
-	initGLTextureNam(gTextureNames[108], "textures/background3.data", false, true);
-	initGLTextureNam(gTextureNames[109], "textures/background4.data", false, true);
-	initGLTextureNam(gTextureNames[110], "textures/background5.data", false, true);
-	initGLTextureNam(gTextureNames[111], "textures/background6.data", false, true);
-	initGLTextureNam(gTextureNames[112], "textures/transparent2.data", false, true);
-	initGLTextureNam(gTextureNames[113], "textures/snow20.data", false, false);
-	initGLTextureNam(gTextureNames[114], "textures/snow21.data", false, false);
-	
+
 	gTextureNames[119] = gTextureNames[36];
 	gTextureNames[120] = gTextureNames[36];
 	gTextureNames[121] = gTextureNames[36];
-	
-	initGLTextureNam(gTextureNames[122], "textures/snowbg1.data", false, true);
-	initGLTextureNam(gTextureNames[123], "textures/snowbg2.data", false, true);
-	initGLTextureNam(gTextureNames[124], "textures/snowbg3.data", false, true);
-	initGLTextureNam(gTextureNames[125], "textures/snowbg4.data", false, true);
+
 	gTextureNames[128] = gTextureNames[26];  // bonus 1up
-	initGLTextureNam(gTextureNames[129], "textures/goal1.data", false, true);
-	initGLTextureNam(gTextureNames[130], "textures/goal2.data", false, true);
-	initGLTextureNam(gTextureNames[132], "textures/finalgoal.data", false, true);
-	
-	initGLTextureNam(gTextureNames[136], "textures/run1.data", false, true);
-	initGLTextureNam(gTextureNames[137], "textures/run2.data", false, true);
-	initGLTextureNam(gTextureNames[138], "textures/run3.data", false, true);
-	initGLTextureNam(gTextureNames[139], "textures/run4.data", false, true);
 
-	
-	initGLTextureNam(gTextureNames[200], "textures/water-trans.data", false, true);
-	initGLTextureNam(gTextureNames[201], "textures/waves-trans.data", false, true);
-	
-	initGLTextureNam(gTextureNames[257], "textures/transparent.data", false, true);
-	
-	assert(glGetError() == GL_NO_ERROR);
 }
 
+enum { BATCH_MAX_QUADS = 4096 };  // 4 vertices per quad, u16 indices
+
+// Sprite batcher. drawGLvertices() queues quads here, and batchFlush() draws
+// each run of quads that share a texture with a single glDrawElements().
+struct batch {
+	float verts[BATCH_MAX_QUADS * 16];  // x, y, s, t per vertex
+	uint32_t texnams[BATCH_MAX_QUADS];
+	size_t len;
+	uint32_t vbo, ibo;
+	bool disabled;  // flush after every quad, to compare against
+};
+static struct batch gBatch;
+
 static void drawGLvertices(
 	const float *const,
 	const uint32_t
 );
+static void batchQuad(const float *const, const uint32_t);
+static void batchFlush(bool sortByTexture);
+static void initialize_batch(void);
+#ifndef MACOSX
+static void initialize_scene(void);
+static void initialize_depth(void);
+#endif
 
 static int cmpForUint8_t(const void *p, const void *q) {
 	const uint8_t *const a = (const uint8_t *const)p;
@@ -1414,25 +2100,664 @@ static WorldItem *worldItem_new_block(enum stl_obj_type type, int x, int y) {
 	return w;
 }
 
-// Draw some nice (non-interactive) scenery.
-static void paintTM(uint8_t **tm) {
-	const size_t nTilesScrolledOver = gScrollOffset / TILE_WIDTH;
-	const bool tuxIsBetweenTiles = gScrollOffset % TILE_WIDTH != 0 &&
-		gScrollOffset + gWindowWidth < lvl.width * TILE_WIDTH ? 1 : 0;
-	for (int h = 0; h < gWindowHeight / TILE_HEIGHT; h++)
-		for (size_t w = nTilesScrolledOver;
-			w < nTilesScrolledOver + gWindowWidth / TILE_WIDTH + tuxIsBetweenTiles;
-			w++) {
-			const int x = w * TILE_WIDTH - gScrollOffset;  // window coordinates
-			const int y = gWindowHeight - h * TILE_HEIGHT;  // ibid
-			paintTile(tm[h][w], x, y);
+enum { TM_BACKGROUND, TM_INTERACTIVE, TM_FOREGROUND, TM_NLAYERS };
+
+// A level's tilemaps and background image. The simulation hands one to the
+// renderer every time it loads a level; the renderer owns it from then on.
+struct levelGeom {
+	uint32_t gen;  // which load of a level this is
+	int width, height;
+	uint8_t *tm[TM_NLAYERS];  // width * height tileIDs each, row by row
+	char *background;  // 640x480 texels, or NULL for no background
+	enum texFormat backgroundFormat;  // background's
+	bool backgroundOpaque;  // background has no transparent texels
+};
+
+enum {
+	SNAP_ROWS = 15,  // gWindowHeight / TILE_HEIGHT
+	SNAP_COLS = 22,  // gWindowWidth / TILE_WIDTH + 1, for a partial column,
+	                 // + 1 for drawing between ticks
+	SNAP_MAX_SPRITES = 2048,
+	SNAP_MESSAGE_LEN = 64,
+};
+
+// A textured quad in window coordinates.
+struct sprite {
+	float xy[8];  // x, y of each vertex, in triangle strip order
+	int motion[2];  // how far it moved in the tick (y up), or 0 if it jumped
+	uint32_t texnam;
+};
+
+// Everything the renderer needs to draw one simulation tick. The simulation
+// fills these in and never reads them back, so a published snapshot does not
+// change under the renderer.
+struct frameSnapshot {
+	uint64_t tick;
+	int64_t time;  // monotonicNS() when it was simulated
+	int64_t period;  // ns until the next tick; 0 to only draw it as it is
+	uint32_t levelGen;
+	int scrollOffset;
+	int prevScrollOffset;  // when the tick began
+	int firstCol, nCols;  // the columns of the level visible in the tick
+	uint8_t tiles[TM_NLAYERS][SNAP_ROWS][SNAP_COLS];  // of the visible columns
+	size_t nItemsVisited;  // WorldItems looked at to find the nWorldSprites
+	size_t nWorldSprites;  // sprites drawn under the foreground layer
+	size_t nSprites;  // the rest are drawn over it
+	struct sprite sprites[SNAP_MAX_SPRITES];
+	char message[SNAP_MESSAGE_LEN];  // drawn over everything; "" for none
+	int messageBg;  // the glyph behind each of its characters
+};
+
+// A tilemap layer. Its vbo holds one quad per cell for the whole level, in
+// level coordinates, column by column (so the visible columns are contiguous).
+// The background and foreground layers are also drawn into chunks: textures
+// of one window's width of the level each, so a frame needs at most two, and
+// only those two are kept.
+struct tmLayer {
+	uint32_t vbo;
+	enum texKind kind;  // the lowest kind of its tiles
+	int nChunks;
+	struct tmChunk *chunks;
+};
+
+// Only the bounding box of a chunk's tiles gets drawn, to save fill.
+struct tmChunk {
+	bool built;
+	uint32_t texnam;  // 0 if there are no tiles in it
+	int x0, y0, x1, y1;  // the bounding box, in window coordinates
+};
+static struct tmLayer gTMLayers[TM_NLAYERS];
+static bool gTMChunks = true;  // false: draw every layer from its vbo
+static bool gEarlyZ;  // see paintLayersEarlyZ()
+static uint32_t gChunkFbo;
+static uint32_t gSceneFbo;  // what frames are drawn into; see beginScene()
+static int gChunkWidth, gChunkHeight;  // texels; the viewport's size
+static int gDrawScroll;  // the scroll the frame is drawn at; see drawSnapshot()
+static float gDrawFraction = 1;  // ibid, how far into the snapshot's tick
+
+// The level the renderer is drawing. Its interactive tilemap is kept up to
+// date with what is in gTMLayers[TM_INTERACTIVE].
+static struct levelGeom *gDrawnGeom;
+static uint32_t gBackgroundTexnam;  // gDrawnGeom's
+static bool gBackgroundOpaque;  // gBackgroundTexnam has no transparent texels
+static bool gBackgroundRepeats;  // the GL can wrap it (NPOT GL_REPEAT)
+static int gBackgroundFormat = -1;  // its texFormat in gTexMemory, or -1
+static bool gViewportFillsWindow;  // no letterboxing to clear
+// The level whose background texloader.c is uploading into
+// gBackgroundLoad.texnam, which then trades places with gTextureNames[256].
+static struct levelGeom *gLoadingGeom;
+#ifndef MACOSX
+static struct texLoad gBackgroundLoad;
+static bool gRenderThread;  // frames are drawn by renderFrame()
+#endif
+
+// Whether a tile gets drawn at all.
+static bool isPaintedTile(const uint8_t tileID) {
+	return tileID != 0 && !bsearch(&tileID, ignored_tiles,
+		sizeof(ignored_tiles)/sizeof(uint8_t), sizeof(uint8_t), cmpForUint8_t);
+}
+
+static enum texKind tileKind(const uint8_t tileID) {
+	return texKind(gTextureNames[tileID]);
+}
+
+// Whether a tile hides whatever is drawn under it.
+static bool isOpaqueTile(const uint8_t tileID) {
+	return isPaintedTile(tileID) && tileKind(tileID) == TEX_OPAQUE;
+}
+
+// The tile of layer l at cell (h, w) of geom, or 0 if an opaque tile of a later
+// layer covers it (WorldItems only go under the foreground layer, so they
+// don't change that).
+static uint8_t visibleTile(const struct levelGeom *const geom, const int l,
+	const int h, const int w) {
+	const size_t cell = (size_t)h * geom->width + w;
+	for (int above = l + 1; above < TM_NLAYERS; above++)
+		if (isOpaqueTile(geom->tm[above][cell]))
+			return 0;
+	return geom->tm[l][cell];
+}
+
+// Print how much drawing the level's tiles would overdraw, and how many of
+// them visibleTile() culls.
+static void printOverdrawStats(const struct levelGeom *const geom) {
+	size_t painted[TM_NLAYERS] = { 0 }, hidden[TM_NLAYERS] = { 0 };
+	size_t nPainted = 0, nHidden = 0, nCovered = 0;
+	for (int h = 0; h < geom->height; h++)
+		for (int w = 0; w < geom->width; w++) {
+			bool covered = false;
+			for (int l = 0; l < TM_NLAYERS; l++) {
+				if (!isPaintedTile(geom->tm[l][(size_t)h * geom->width + w]))
+					continue;
+				covered = true;
+				painted[l]++;
+				if (!visibleTile(geom, l, h, w))
+					hidden[l]++;
+			}
+			nCovered += covered;
 		}
+	for (int l = 0; l < TM_NLAYERS; l++) {
+		nPainted += painted[l];
+		nHidden += hidden[l];
+	}
+	fprintf(stderr, "DEBUG: overdraw: %zu of %zu tiles hidden by opaque ones "
+		"(%zu of %zu background, %zu of %zu interactive), %.2f tiles per "
+		"covered cell instead of %.2f\n", nHidden, nPainted,
+		hidden[TM_BACKGROUND], painted[TM_BACKGROUND], hidden[TM_INTERACTIVE],
+		painted[TM_INTERACTIVE],
+		nCovered ? (double)(nPainted - nHidden) / nCovered : 0,
+		nCovered ? (double)nPainted / nCovered : 0);
 }
 
-// Helper for loadLevel.
-static void loadLevelInteractives(void) {
-	// Load in the interactives all at once, one time.
-	// (Painting for interactives happens elsewhere, repeatedly.)
+// Write the quad for the tile at cell (h, w) in level coordinates. Empty and
+// ignored tiles get a zero-area quad, so they rasterize nothing.
+static void tileQuad(float *const quad, const uint8_t tileID, const int h,
+	const int w) {
+	if (!isPaintedTile(tileID)) {
+		memset(quad, 0, 16 * sizeof(float));
+		return;
+	}
+	
+	const float x = w * TILE_WIDTH, y = gWindowHeight - h * TILE_HEIGHT;
+	const int slot = gTileAtlasSlot[tileID];
+	const float col = slot % ATLAS_SLOTS_PER_ROW;
+	const float row = slot / ATLAS_SLOTS_PER_ROW;
+	const float s0 = (col + 0.0001) / ATLAS_SLOTS_PER_ROW;
+	const float s1 = (col + 0.9999) / ATLAS_SLOTS_PER_ROW;
+	const float t0 = (row + 0.0001) / ATLAS_SLOTS_PER_ROW;
+	const float t1 = (row + 0.9999) / ATLAS_SLOTS_PER_ROW;
+	const float vertices[] = {
+		x,				y,					s0, t0,
+		x,				y - TILE_HEIGHT,	s0, t1,
+		x + TILE_WIDTH,	y,					s1, t0,
+		x + TILE_WIDTH,	y - TILE_HEIGHT,	s1, t1,
+	};
+	memcpy(quad, vertices, sizeof(vertices));
+}
+
+// Forget a chunk texture of a layer; it gets drawn again when needed.
+static void dropTMChunk(struct tmLayer *const layer, const int i) {
+	if (i >= layer->nChunks)
+		return;
+	glDeleteTextures(1, &layer->chunks[i].texnam);
+	layer->chunks[i] = (struct tmChunk){ 0 };
+}
+
+static void dropTMChunks(struct tmLayer *const layer) {
+	for (int i = 0; i < layer->nChunks; i++)
+		dropTMChunk(layer, i);
+}
+
+// Upload the quads of every cell of layer l of geom into its buffer. Tiles
+// that later layers cover get empty quads.
+static void buildTMLayer(const int l, const struct levelGeom *const geom) {
+	struct tmLayer *const layer = &gTMLayers[l];
+	if (!layer->vbo)
+		glGenBuffers(1, &layer->vbo);
+	
+	const size_t nCells = (size_t)geom->width * geom->height;
+	float *const quads = nnmalloc(nCells * 16 * sizeof(float));
+	layer->kind = TEX_OPAQUE;
+	for (int w = 0; w < geom->width; w++)
+		for (int h = 0; h < geom->height; h++) {
+			const uint8_t tileID = visibleTile(geom, l, h, w);
+			tileQuad(&quads[((size_t)w * geom->height + h) * 16], tileID, h, w);
+			if (isPaintedTile(tileID) && tileKind(tileID) < layer->kind)
+				layer->kind = tileKind(tileID);
+		}
+	glsBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+	glBufferData(GL_ARRAY_BUFFER, nCells * 16 * sizeof(float), quads,
+		GL_STATIC_DRAW);
+	free(quads);
+	glCheck();
+	
+	// the chunks are redrawn from the new vbo as they come into view
+	dropTMChunks(layer);
+	layer->nChunks = (geom->width * TILE_WIDTH + gWindowWidth - 1) /
+		gWindowWidth;
+	free(layer->chunks);
+	layer->chunks = calloc(layer->nChunks, sizeof(struct tmChunk));
+	must(layer->chunks || !layer->nChunks);
+}
+
+// Change a tile of the interactive layer. The renderer patches its buffer
+// when the tile shows up in a snapshot.
+static void setInteractiveTile(const int h, const int w, const uint8_t tileID) {
+	assert(h >= 0 && h < lvl.height && w >= 0 && w < lvl.width);
+	lvl.interactivetm[h][w] = tileID;
+}
+
+// Rewrite the quad of cell (h, w) of layer l from gDrawnGeom.
+static void patchTMCell(const int l, const int h, const int w) {
+	struct tmLayer *const layer = &gTMLayers[l];
+	const uint8_t tileID = visibleTile(gDrawnGeom, l, h, w);
+	if (isPaintedTile(tileID) && tileKind(tileID) < layer->kind)
+		layer->kind = tileKind(tileID);
+	
+	float quad[16];
+	tileQuad(quad, tileID, h, w);
+	glsBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+	GLS(glBufferSubData(GL_ARRAY_BUFFER,
+		((size_t)w * gDrawnGeom->height + h) * 16 * sizeof(float),
+		sizeof(quad), quad));
+}
+
+// Patch the quads of the visible interactive tiles that changed since they
+// were last drawn, and of the background tiles they uncover or cover.
+static void syncInteractiveTiles(const struct frameSnapshot *const snap) {
+	uint8_t *const tm = gDrawnGeom->tm[TM_INTERACTIVE];
+	for (int c = 0; c < snap->nCols; c++)
+		for (int h = 0; h < gDrawnGeom->height; h++) {
+			const int w = snap->firstCol + c;
+			const uint8_t tileID = snap->tiles[TM_INTERACTIVE][h][c];
+			const uint8_t was = tm[(size_t)h * gDrawnGeom->width + w];
+			if (was == tileID)
+				continue;
+			tm[(size_t)h * gDrawnGeom->width + w] = tileID;
+			patchTMCell(TM_INTERACTIVE, h, w);
+			if (isOpaqueTile(was) != isOpaqueTile(tileID)) {
+				patchTMCell(TM_BACKGROUND, h, w);
+				dropTMChunk(&gTMLayers[TM_BACKGROUND],
+					w * TILE_WIDTH / gWindowWidth);
+			}
+		}
+}
+
+// Draw the visible columns of a layer with one draw call. The vertex shader
+// does the scrolling.
+static void paintTMLayer(const struct tmLayer *const layer,
+	const struct frameSnapshot *const snap) {
+	if (snap->nCols <= 0)
+		return;
+	const size_t nQuads = (size_t)snap->nCols * gDrawnGeom->height;
+	must(nQuads <= BATCH_MAX_QUADS);
+	
+	glsTexKind(layer->kind);
+	glsScroll(gDrawScroll, 0);
+	glsBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+	glsVertexAttribPointer((const void *)
+		((size_t)snap->firstCol * gDrawnGeom->height * 16 * sizeof(float)));
+	glsBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBatch.ibo);
+	glsBindTexture(gTileAtlas);
+	glsDrawQuads(0, nQuads);
+	glsScroll(0, 0);
+	
+	gRenderStats.quads += nQuads;
+}
+
+#ifndef MACOSX  // framebuffer objects aren't core in the Mac's GL 2.1
+// Draw chunk i of a layer into a texture, at the viewport's resolution. Skip
+// the texture if none of its cells has a tile.
+static void buildTMChunk(const int l, const int i) {
+	struct tmLayer *const layer = &gTMLayers[l];
+	struct tmChunk *const chunk = &layer->chunks[i];
+	const int firstCol = i * gWindowWidth / TILE_WIDTH;
+	int nCols = gWindowWidth / TILE_WIDTH;
+	if (firstCol + nCols > gDrawnGeom->width)
+		nCols = gDrawnGeom->width - firstCol;
+	int c0 = nCols, c1 = -1, h0 = gDrawnGeom->height, h1 = -1;
+	enum texKind kind = TEX_OPAQUE;
+	for (int h = 0; h < gDrawnGeom->height; h++)
+		for (int c = 0; c < nCols; c++) {
+			const uint8_t tileID = visibleTile(gDrawnGeom, l, h, firstCol + c);
+			if (!isPaintedTile(tileID))
+				continue;
+			c0 = c < c0 ? c : c0;
+			c1 = c > c1 ? c : c1;
+			h0 = h < h0 ? h : h0;
+			h1 = h > h1 ? h : h1;
+			kind = tileKind(tileID) < kind ? tileKind(tileID) : kind;
+		}
+	// an empty cell in the bounding box leaves transparent texels
+	for (int h = h0; kind == TEX_OPAQUE && h <= h1; h++)
+		for (int c = c0; c <= c1; c++)
+			if (!isPaintedTile(visibleTile(gDrawnGeom, l, h, firstCol + c))) {
+				kind = TEX_CUTOUT;
+				break;
+			}
+	*chunk = (struct tmChunk){
+		.built = true,
+		.x0 = c0 * TILE_WIDTH, .x1 = (c1 + 1) * TILE_WIDTH,
+		.y0 = gWindowHeight - (h1 + 1) * TILE_HEIGHT,
+		.y1 = gWindowHeight - h0 * TILE_HEIGHT,
+	};
+	if (chunk->y0 < 0)
+		chunk->y0 = 0;
+	gRenderStats.chunksBuilt++;
+	if (c1 < 0 || chunk->y0 >= chunk->y1)
+		return;
+	const int viewport[4] = { gGLState.viewport[0], gGLState.viewport[1],
+		gGLState.viewport[2], gGLState.viewport[3] };
+	
+	GLS(glGenTextures(1, &chunk->texnam));
+	setTexKind(chunk->texnam, kind);
+	glsBindTexture(chunk->texnam);
+	GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+	GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	GLS(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gChunkWidth, gChunkHeight, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+	glsBindFramebuffer(gChunkFbo);
+	GLS(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, chunk->texnam, 0));
+	must(GLS(glCheckFramebufferStatus(GL_FRAMEBUFFER)) ==
+		GL_FRAMEBUFFER_COMPLETE);
+	
+	glsViewport(0, 0, gChunkWidth, gChunkHeight);
+	const bool depthTest = gGLState.depthTest == 1;  // gChunkFbo has no depth
+	glsDepthTest(false);
+	GLS(glClearColor(0, 0, 0, 0));
+	GLS(glClear(GL_COLOR_BUFFER_BIT));
+	// The tiles don't overlap, so the chunk can take their texels as they
+	// are and be blended (or alpha tested) when it is drawn.
+	glsTexKind(TEX_OPAQUE);
+	glsScroll(i * gWindowWidth, 0);
+	glsBindBuffer(GL_ARRAY_BUFFER, layer->vbo);
+	glsVertexAttribPointer((const void *)
+		((size_t)firstCol * gDrawnGeom->height * 16 * sizeof(float)));
+	glsBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBatch.ibo);
+	glsBindTexture(gTileAtlas);
+	glsDrawQuads(0, (size_t)nCols * gDrawnGeom->height);
+	glsScroll(0, 0);
+	
+	glsBindFramebuffer(gSceneFbo);
+	glsViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glsDepthTest(depthTest);
+	gRenderStats.quads += (size_t)nCols * gDrawnGeom->height;
+	glCheck();
+}
+
+// Draw the (at most two) chunks of a layer in view at gDrawScroll, building
+// any that are not yet.
+static void paintTMChunks(const int l) {
+	if (gGLState.viewport[2] != gChunkWidth ||
+		gGLState.viewport[3] != gChunkHeight) {  // resized, so start over
+		for (int i = 0; i < TM_NLAYERS; i++)
+			dropTMChunks(&gTMLayers[i]);
+		gChunkWidth = gGLState.viewport[2];
+		gChunkHeight = gGLState.viewport[3];
+	}
+	
+	struct tmLayer *const layer = &gTMLayers[l];
+	const int first = gDrawScroll / gWindowWidth;
+	int last = (gDrawScroll + gWindowWidth - 1) / gWindowWidth;
+	if (last >= layer->nChunks)
+		last = layer->nChunks - 1;
+	// Each chunk is a viewport-sized texture, so only the ones in view are
+	// kept; the rest would add up to hundreds of MB over a level at 1080p.
+	for (int i = 0; i < layer->nChunks; i++)
+		if (layer->chunks[i].built && (i < first || i > last))
+			dropTMChunk(layer, i);
+	for (int i = first; i <= last; i++) {
+		const struct tmChunk *const chunk = &layer->chunks[i];
+		if (!chunk->built)
+			buildTMChunk(l, i);
+		if (!chunk->texnam)
+			continue;
+		// the bounding box, with the texture's rows going bottom-up
+		const float x = i * gWindowWidth - gDrawScroll;
+		const float s0 = (float)chunk->x0 / gWindowWidth;
+		const float s1 = (float)chunk->x1 / gWindowWidth;
+		const float t0 = (float)chunk->y0 / gWindowHeight;
+		const float t1 = (float)chunk->y1 / gWindowHeight;
+		const float quad[] = {
+			x + chunk->x0,	chunk->y1,	s0, t1,
+			x + chunk->x0,	chunk->y0,	s0, t0,
+			x + chunk->x1,	chunk->y1,	s1, t1,
+			x + chunk->x1,	chunk->y0,	s1, t0,
+		};
+		batchQuad(quad, chunk->texnam);
+	}
+}
+#endif
+
+// Draw some nice (non-interactive) scenery.
+static void paintTM(const int layer, const struct frameSnapshot *const snap) {
+	batchFlush(false);  // the layer's tiles get sorted by texture on their own
+#ifndef MACOSX
+	if (gStaticTilemaps && gTMChunks && layer != TM_INTERACTIVE)
+		return paintTMChunks(layer);
+#endif
+	if (gStaticTilemaps)
+		return paintTMLayer(&gTMLayers[layer], snap);
+	
+	// the columns in view at gDrawScroll, of the ones in the snapshot
+	const int scrollOffset = gDrawScroll;
+	const int c0 = scrollOffset / TILE_WIDTH - snap->firstCol;
+	int c1 = (scrollOffset + gWindowWidth - 1) / TILE_WIDTH + 1 -
+		snap->firstCol;
+	if (c1 > snap->nCols)
+		c1 = snap->nCols;
+	for (int h = 0; h < gWindowHeight / TILE_HEIGHT; h++)
+		for (int c = c0; c < c1; c++) {
+			const int w = snap->firstCol + c;
+			const int x = w * TILE_WIDTH - scrollOffset;  // window coordinates
+			const int y = gWindowHeight - h * TILE_HEIGHT;  // ibid
+			bool covered = false;  // see visibleTile()
+			for (int above = layer + 1; above < TM_NLAYERS; above++)
+				covered = covered || isOpaqueTile(snap->tiles[above][h][c]);
+			if (!covered)
+				paintTile(snap->tiles[layer][h][c], x, y);
+		}
+	batchFlush(true);
+}
+
+// Snapshots go from the simulation to the renderer through a triple buffer:
+// the simulation fills in gSnaps[gSnapBack], publishing swaps it with
+// gSnapReady, and the renderer swaps gSnapReady with gSnapFront to draw the
+// latest one. Neither side holds the lock for longer than a swap.
+static struct frameSnapshot gSnaps[3];
+static int gSnapBack = 0, gSnapReady = 1, gSnapFront = 2;
+static bool gSnapFresh;  // gSnapReady is newer than gSnapFront
+static struct levelGeom *gPendingGeom;  // published, not picked up yet
+static uint32_t gLevelGen;  // the gen of the level being simulated
+static bool gInterpolate = true;  // draw between ticks; STL_PLAYER_INTERPOLATE
+
+// Simulation timings, next to the renderer's gRenderStats.
+struct simStats {
+	uint64_t ticks, dropped;  // dropped: published but never drawn
+	uint64_t late;  // ticks skipped because the simulation fell behind
+	int64_t tick_ns, cpu_ns;
+};
+static struct simStats gSimStats;
+
+#ifndef MACOSX
+static mtx_t gSnapMtx;  // guards the above (but not the snapshots' contents)
+static cnd_t gSnapCnd;  // signaled whenever a snapshot is published
+#endif
+
+static void snapLock(void) {
+#ifndef MACOSX
+	mutexLock(&gSnapMtx);
+#endif
+}
+
+static void snapUnlock(void) {
+#ifndef MACOSX
+	mutexUnlock(&gSnapMtx);
+#endif
+}
+
+static void initialize_snapshots(void) {
+#ifndef MACOSX
+	must(thrd_success == mtx_init(&gSnapMtx, mtx_plain));
+	must(thrd_success == cnd_init(&gSnapCnd));
+#endif
+}
+
+static void freeLevelGeom(struct levelGeom *const geom) {
+	if (!geom)
+		return;
+	for (int i = 0; i < TM_NLAYERS; i++)
+		free(geom->tm[i]);
+	free(geom->background);
+	free(geom);
+}
+
+// Hand geom over to the renderer. Replaces one it has not picked up yet.
+static void publishLevelGeom(struct levelGeom *const geom) {
+	snapLock();
+	freeLevelGeom(gPendingGeom);
+	gPendingGeom = geom;
+	snapUnlock();
+}
+
+// Make the filled-in snapshot the latest one. tick_ns is how long it took.
+static void publishSnapshot(const int64_t tick_ns) {
+	snapLock();
+	const int ready = gSnapReady;
+	gSnapReady = gSnapBack;
+	gSnapBack = ready;
+	if (gSnapFresh)
+		gSimStats.dropped++;
+	gSnapFresh = true;
+	gSimStats.ticks++;
+	gSimStats.tick_ns += tick_ns;
+#ifndef MACOSX
+	cnd_signal(&gSnapCnd);
+#endif
+	snapUnlock();
+}
+
+// The wrap mode of the level background's texture. GLES2 only has NPOT
+// textures repeat with GL_OES_texture_npot.
+static int backgroundWrap(void) {
+#ifdef MACOSX
+	gBackgroundRepeats = true;
+#else
+	const char *const exts = (const char *)glGetString(GL_EXTENSIONS);
+	gBackgroundRepeats = exts && strstr(exts, "GL_OES_texture_npot");
+#endif
+	return gBackgroundRepeats ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+}
+
+#ifndef MACOSX
+// Have the loader thread upload geom's background, for useLevelGeom() to swap
+// in once texLoaderDone().
+static void loadLevelGeom(struct levelGeom *const geom) {
+	gBackgroundLoad.width = 640;
+	gBackgroundLoad.height = 480;
+	gBackgroundLoad.texels = geom->background;
+	gBackgroundLoad.format = kTexFormats[geom->backgroundFormat].format;
+	gBackgroundLoad.type = kTexFormats[geom->backgroundFormat].type;
+	gBackgroundLoad.filter = GL_LINEAR;
+	gBackgroundLoad.wrap = backgroundWrap();
+	texLoaderSubmit(&gBackgroundLoad);
+	gLoadingGeom = geom;
+}
+#endif
+
+// Build the renderer's copy of a level: the tilemap buffers and background.
+static void useLevelGeom(struct levelGeom *const geom) {
+	printOverdrawStats(geom);
+	for (int i = 0; i < TM_NLAYERS && !gQuads; i++)
+		buildTMLayer(i, geom);
+	
+#ifndef MACOSX
+	if (geom->background && gQuads) {
+		gQuads->texImage(gTextureNames[256], 640, 480, geom->background, true);
+		gBackgroundTexnam = gTextureNames[256];
+	} else if (geom->background && gTexLoader) {  // by the loader thread
+		const uint32_t texnam = gBackgroundLoad.texnam;
+		gBackgroundLoad.texnam = gTextureNames[256];
+		gTextureNames[256] = texnam;
+		// bound again, as this context only sees the upload after that
+		gGLState.texture = texnam;
+		glBindTexture(GL_TEXTURE_2D, texnam);
+		gBackgroundTexnam = texnam;
+	} else
+#endif
+	if (geom->background) {
+		const int wrap = backgroundWrap();
+		glsBindTexture(gTextureNames[256]);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+		const enum texFormat f = geom->backgroundFormat;
+		glTexImage2D(GL_TEXTURE_2D, 0, kTexFormats[f].format, 640, 480, 0,
+			kTexFormats[f].format, kTexFormats[f].type, geom->background);
+		glCheck();
+		gBackgroundTexnam = gTextureNames[256];
+	} else
+		gBackgroundTexnam = gTextureNames[0];
+	gBackgroundOpaque = geom->background && geom->backgroundOpaque;
+	if (!gQuads) {  // in gTexMemory, instead of the old level's
+		if (gBackgroundFormat >= 0)
+			countTexMemory(gBackgroundFormat, 640 * 480, true, -1);
+		gBackgroundFormat = geom->background ? (int)geom->backgroundFormat : -1;
+		if (gBackgroundFormat >= 0) {
+			countTexMemory(gBackgroundFormat, 640 * 480, true, 1);
+			printTexMemory();
+		}
+	}
+	setTexKind(gTextureNames[256], gBackgroundOpaque ? TEX_OPAQUE :
+		TEX_TRANSLUCENT);
+	free(geom->background);  // the renderer has no further use for it
+	geom->background = NULL;
+	
+	freeLevelGeom(gDrawnGeom);
+	gDrawnGeom = geom;
+}
+
+// Make the latest snapshot gSnaps[gSnapFront], picking up its level if it is
+// a new one. If wait, give the simulation up to 100 ms to publish one, and
+// return false if it did not; otherwise the last one can be drawn again.
+// Return whether gSnaps[gSnapFront] can be drawn.
+static bool acquireSnapshot(const bool wait) {
+	snapLock();
+#ifndef MACOSX
+	if (wait && !gSnapFresh) {
+		struct timespec deadline;
+		assert(TIME_UTC == timespec_get(&deadline, TIME_UTC));
+		tsadd(&deadline, NSONE / 10);
+		while (!gSnapFresh)
+			if (cnd_timedwait(&gSnapCnd, &gSnapMtx, &deadline) != thrd_success)
+				break;
+	}
+#endif
+	const bool fresh = gSnapFresh;
+	if (fresh) {
+		const int ready = gSnapReady;
+		gSnapReady = gSnapFront;
+		gSnapFront = ready;
+		gSnapFresh = false;
+	}
+	const struct frameSnapshot *const snap = &gSnaps[gSnapFront];
+	struct levelGeom *geom = NULL;
+	if (!gLoadingGeom && (!gDrawnGeom || gDrawnGeom->gen != snap->levelGen) &&
+		gPendingGeom && gPendingGeom->gen == snap->levelGen) {
+		geom = gPendingGeom;
+		gPendingGeom = NULL;
+	}
+	snapUnlock();
+	
+#ifndef MACOSX
+	// The old level is drawn until the new one's background is uploaded. With
+	// no render thread, there is nothing else to draw meanwhile, so wait.
+	if (geom && geom->background && gTexLoader) {
+		loadLevelGeom(geom);
+		geom = NULL;
+	}
+	if (gLoadingGeom && texLoaderDone(&gBackgroundLoad, !gRenderThread)) {
+		geom = gLoadingGeom;
+		gLoadingGeom = NULL;
+	}
+#endif
+	if (geom)
+		useLevelGeom(geom);
+	if (wait && !fresh)
+		return false;
+	return snap->tick > 0 && gDrawnGeom && gDrawnGeom->gen == snap->levelGen;
+}
+
+static bool loadLevelBackground(struct levelGeom *const geom);
+
+// Helper for loadLevel.
+static void loadLevelInteractives(void) {
+	// Load in the interactives all at once, one time.
+	// (Painting for interactives happens elsewhere, repeatedly.)
 	for (int h = 0; h < lvl.height; h++)
 		for (int w = 0; w < lvl.width; w++) {
 			uint8_t tileID = lvl.interactivetm[h][w];
@@ -1587,10 +2912,7 @@ static bool loadLevel(const char *const level_filename) {
 	// load the new level
 	lrFailCleanup(NULL, &lvl);
 	
-	must(gSelf_len + strlen(level_filename) < 4096);
-	strcpy(gSelf + gSelf_len, level_filename);
-	lvl = levelReader(gSelf);
-	gSelf[gSelf_len] = '\0';
+	lvl = levelReader(level_filename);
 	
 	if (!lvl.hdr)
 		return false;
@@ -1605,165 +2927,320 @@ static bool loadLevel(const char *const level_filename) {
 	loadLevelObjects();
 	loadLevelInteractives();
 	
+	// copy out what the renderer needs, since lvl is the simulation's
+	must(lvl.height <= SNAP_ROWS);
+	struct levelGeom *const geom = nnmalloc(sizeof(struct levelGeom));
+	geom->gen = ++gLevelGen;
+	geom->width = lvl.width;
+	geom->height = lvl.height;
+	uint8_t **const tms[TM_NLAYERS] = {
+		lvl.backgroundtm, lvl.interactivetm, lvl.foregroundtm,
+	};
+	for (int i = 0; i < TM_NLAYERS; i++) {
+		geom->tm[i] = nnmalloc((size_t)lvl.width * lvl.height);
+		for (int h = 0; h < lvl.height; h++)
+			memcpy(&geom->tm[i][(size_t)h * lvl.width], tms[i][h], lvl.width);
+	}
+	geom->background = NULL;
+	if (!loadLevelBackground(geom)) {
+		freeLevelGeom(geom);
+		return false;
+	}
+	publishLevelGeom(geom);
+	
 	return true;
 }
 
-// Populate the gObjTextureNames array with textures (that last the whole game).
+// Textures for the objects and badguys (that last the whole game).
+static const texUpload kObjTextures[] = {
+	{ &gObjTextureNames[STL_TUX_LEFT],
+		"textures/tux.data", false, true },
+	{ &gObjTextureNames[STL_TUX_RIGHT],
+		"textures/tux.data", true, true },
+	{ &gObjTextureNames[STL_ICEBLOCK_TEXTURE_LEFT],
+		"textures/mriceblock.data", false, true },
+	{ &gObjTextureNames[STL_ICEBLOCK_TEXTURE_RIGHT],
+		"textures/mriceblock.data", true, true },
+	{ &gObjTextureNames[STL_DEAD_MRICEBLOCK_TEXTURE_LEFT],
+		"textures/mriceblock-flat-left.data", false, true },
+	{ &gObjTextureNames[STL_DEAD_MRICEBLOCK_TEXTURE_RIGHT],
+		"textures/mriceblock-flat-left.data", true, true },
+	{ &gObjTextureNames[STL_SNOWBALL_TEXTURE_LEFT],
+		"textures/Asnowball.data", false, true },
+	{ &gObjTextureNames[STL_SNOWBALL_TEXTURE_RIGHT],
+		"textures/Asnowball.data", true, true },
+	{ &gObjTextureNames[STL_BOUNCINGSNOWBALL_TEXTURE_LEFT],
+		"textures/Abouncingsnowball.data", false, true },
+	{ &gObjTextureNames[STL_BOUNCINGSNOWBALL_TEXTURE_RIGHT],
+		"textures/Abouncingsnowball.data", true, true },
+	{ &gObjTextureNames[STL_BOMB_TEXTURE_LEFT],
+		"textures/bomb.data", false, true },
+	{ &gObjTextureNames[STL_BOMB_TEXTURE_RIGHT],
+		"textures/bomb.data", true, true },
+	{ &gObjTextureNames[STL_BOMBX_TEXTURE_LEFT],
+		"textures/bombx.data", false, true },
+	{ &gObjTextureNames[STL_BOMBX_TEXTURE_RIGHT],
+		"textures/bombx.data", true, true },
+	{ &gObjTextureNames[STL_BOMB_EXPLODING_TEXTURE_1],
+		"textures/bomb-explosion.data", false, true },
+	{ &gObjTextureNames[STL_BOMB_EXPLODING_TEXTURE_2],
+		"textures/bomb-explosion-1.data", false, true },
+	{ &gObjTextureNames[STL_SPIKY_TEXTURE_LEFT],
+		"textures/spiky.data", false, true },
+	{ &gObjTextureNames[STL_SPIKY_TEXTURE_RIGHT],
+		"textures/spiky.data", true, true },
+	{ &gObjTextureNames[STL_FLYINGSNOWBALL_TEXTURE_LEFT],
+		"textures/flyingsnowball.data", false, true },
+	{ &gObjTextureNames[STL_FLYINGSNOWBALL_TEXTURE_RIGHT],
+		"textures/flyingsnowball.data", true, true },
+	{ &gObjTextureNames[STL_STALACTITE_TEXTURE],
+		"textures/stalactite.data", false, true },
+	{ &gObjTextureNames[STL_JUMPY_TEXTURE],
+		"textures/jumpy.data", false, true },
+	{ &gObjTextureNames[STL_FLAME_TEXTURE],
+		"textures/flame.data", false, true },
+};
+
+// Generate the gObjTextureNames. Their textures are in kObjTextures.
 static bool populateGOTN(void) {
 	static bool ran = false;
 	assert(!ran);
 	ran = true;
 	
-	glGenTextures(gOTNlen, gObjTextureNames);
-	
-	initGLTextureNam(gObjTextureNames[STL_TUX_LEFT], "textures/tux.data",
-		false, true);
-	initGLTextureNam(gObjTextureNames[STL_TUX_RIGHT], "textures/tux.data",
-		true, true);
-	initGLTextureNam(gObjTextureNames[STL_ICEBLOCK_TEXTURE_LEFT],
-		"textures/mriceblock.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_ICEBLOCK_TEXTURE_RIGHT],
-		"textures/mriceblock.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_DEAD_MRICEBLOCK_TEXTURE_LEFT],
-		"textures/mriceblock-flat-left.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_DEAD_MRICEBLOCK_TEXTURE_RIGHT],
-		"textures/mriceblock-flat-left.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_SNOWBALL_TEXTURE_LEFT],
-		"textures/Asnowball.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_SNOWBALL_TEXTURE_RIGHT],
-		"textures/Asnowball.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_BOUNCINGSNOWBALL_TEXTURE_LEFT],
-		"textures/Abouncingsnowball.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_BOUNCINGSNOWBALL_TEXTURE_RIGHT],
-		"textures/Abouncingsnowball.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMB_TEXTURE_LEFT],
-		"textures/bomb.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMB_TEXTURE_RIGHT],
-		"textures/bomb.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMBX_TEXTURE_LEFT],
-		"textures/bombx.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMBX_TEXTURE_RIGHT],
-		"textures/bombx.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMB_EXPLODING_TEXTURE_1],
-		"textures/bomb-explosion.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_BOMB_EXPLODING_TEXTURE_2],
-		"textures/bomb-explosion-1.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_SPIKY_TEXTURE_LEFT],
-		"textures/spiky.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_SPIKY_TEXTURE_RIGHT],
-		"textures/spiky.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_FLYINGSNOWBALL_TEXTURE_LEFT],
-		"textures/flyingsnowball.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_FLYINGSNOWBALL_TEXTURE_RIGHT],
-		"textures/flyingsnowball.data", true, true);
-	initGLTextureNam(gObjTextureNames[STL_STALACTITE_TEXTURE],
-		"textures/stalactite.data", false, true);
-	initGLTextureNam(gObjTextureNames[STL_JUMPY_TEXTURE], "textures/jumpy.data",
-		false, true);
-	initGLTextureNam(gObjTextureNames[STL_FLAME_TEXTURE], "textures/flame.data",
-		false, true);
-	
-	return glGetError() == GL_NO_ERROR;
-}
-
-// Load the level background into gTextureNames[256]. Can be called 1+ times.
-static bool loadLevelBackground(void) {
+	genTextures(gOTNlen, gObjTextureNames);
+	glCheck();
+	
+	return true;
+}
+
+// Read the level background into geom. (The renderer uploads it to
+// gTextureNames[256].)
+static bool loadLevelBackground(struct levelGeom *const geom) {
 #if (defined(MACOSX) && !defined(M1MAC))
 	// weirdly-shaped texture is not accepted by all hardware
-	gTextureNames[256] = gTextureNames[0];
 	return true;
 #endif
-	if (strlen(lvl.background) == 0) {
-		gTextureNames[256] = gTextureNames[0];
+	if (strlen(lvl.background) == 0)
 		return true;
-	}
 	
 	const char *const kDirectory = "textures/";
-	must(gSelf_len + strlen(kDirectory) + strlen(lvl.background) + 1 < 4096);
-	strcpy(gSelf + gSelf_len, kDirectory);
-	strcpy(gSelf + gSelf_len + strlen(kDirectory), lvl.background);
-	if (0 == strcmp(".jpg", gSelf + strlen(gSelf) - 4) ||
-		0 == strcmp(".png", gSelf + strlen(gSelf) - 4))
-		strcpy(gSelf + strlen(gSelf) - 4, ".data");
+	char path[4096];
+	must(strlen(kDirectory) + strlen(lvl.background) + 2 < sizeof(path));
+	strcpy(path, kDirectory);
+	strcat(path, lvl.background);
+	if (strlen(path) > 4 && (0 == strcmp(".jpg", path + strlen(path) - 4) ||
+		0 == strcmp(".png", path + strlen(path) - 4)))
+		strcpy(path + strlen(path) - 4, ".data");
 	
 	ssize_t imgdat_len;
-	char *imgdat = safe_read(gSelf, &imgdat_len);
-	gSelf[gSelf_len] = '\0';
-	
-	assert(imgdat_len == 640 * 480 * 4);
-	glBindTexture(GL_TEXTURE_2D, gTextureNames[256]);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		640,
-		480,
-		0,
-		GL_RGBA,
-		GL_UNSIGNED_BYTE,
-		imgdat
-	);
-	free(imgdat);
-	
-	GLenum glErr = glGetError();
-	return glErr == GL_NO_ERROR;
+	geom->background = vfsRead(path, &imgdat_len);
+	if (imgdat_len != 640 * 480 * 4)
+		return false;
+	// (here, so that the renderer does not have to look through it)
+	geom->backgroundOpaque = imgKind(geom->background, 640 * 480, true) ==
+		TEX_OPAQUE;
+	geom->backgroundFormat = TF_RGBA8888;
+#ifndef MACOSX
+	if (gQuads)  // which take it as it is
+		return true;
+#endif
+	geom->backgroundFormat = pickTexFormat(geom->background, 640 * 480, true,
+		gTexError);
+	char *const packed = packTexels(geom->background, 640 * 480, true,
+		geom->backgroundFormat);
+	if (packed) {
+		free(geom->background);
+		geom->background = packed;
+	}
+	return true;
 }
 
-static uint32_t alphatiles[256];
+static char gAlphaPaths[36][sizeof("textures/alphabet/X.data")];
+static texUpload gAlphaTextures[NGLYPHS];  // in glyph order
 
-// Helper for initialize_alphatiles().
-static void initialize_alphatile(char ch) {
-	const char *const prefix = "textures/alphabet/";
-	char *path = nnmalloc(strlen(prefix) + strlen("X.data") + 1);
-	strcpy(path, prefix);
-	path[strlen(prefix)] = ch;
-	path[strlen(prefix) + 1] = '\0';  // for strcat
-	strcat(path, ".data");
-	initGLTextureNam(alphatiles[(int)ch], path, false, true);
-	free(path);
+// Helper for listAlphaTextures().
+static void listAlphaTexture(char ch, size_t i) {
+	snprintf(gAlphaPaths[i], sizeof(gAlphaPaths[i]), "textures/alphabet/%c.data",
+		ch);
+	gAlphaTextures[i] = (texUpload){ NULL, gAlphaPaths[i], false, true };
 }
 
-// Initialize the tiles used for printing msgs on-screen. Must run exactly once.
-static void initialize_alphatiles(void) {
-	glGenTextures(256, alphatiles);
-	
+// Fill in gAlphaTextures, the glyphs used for printing msgs on-screen.
+static void listAlphaTextures(void) {
+	size_t i = 0;
 	for (char ch = 'a'; ch <= 'z'; ch++) {
-		initialize_alphatile(ch);
+		listAlphaTexture(ch, i++);
 	}
 	for (char ch = '0'; ch <= '9'; ch++) {
-		initialize_alphatile(ch);
+		listAlphaTexture(ch, i++);
 	}
-	initGLTextureNam(alphatiles[255], "textures/alphabet/red.data", false,
-		true);
-	initGLTextureNam(alphatiles[254], "textures/alphabet/green.data", false,
-		true);
+	gAlphaTextures[i++] = (texUpload){ &gMessageBgs[0],
+		"textures/alphabet/red.data", false, true };
+	gAlphaTextures[i++] = (texUpload){ &gMessageBgs[1],
+		"textures/alphabet/green.data", false, true };
+	assert(i == sizeof(gAlphaTextures) / sizeof(gAlphaTextures[0]));
+}
+
+// Gather every texture that lasts the whole game into *rv (caller frees).
+static size_t listStartupTextures(texUpload **const rv) {
+	const size_t nTiles = sizeof(kTileTextures) / sizeof(kTileTextures[0]);
+	const size_t nObjs = sizeof(kObjTextures) / sizeof(kObjTextures[0]);
+	const size_t nAlpha = sizeof(gAlphaTextures) / sizeof(gAlphaTextures[0]);
 	
-	assert(glGetError() == GL_NO_ERROR);
+	*rv = nnmalloc((nTiles + nObjs + nAlpha) * sizeof(texUpload));
+	memcpy(*rv, kTileTextures, sizeof(kTileTextures));
+	memcpy(*rv + nTiles, kObjTextures, sizeof(kObjTextures));
+	memcpy(*rv + nTiles + nObjs, gAlphaTextures, sizeof(gAlphaTextures));
+	return nTiles + nObjs + nAlpha;
+}
+
+// Point every tileID at the atlas slot holding its texture. Aliased tileIDs
+// share the slot of the tile their texture was loaded for.
+static void mapTileAtlasSlots(void) {
+	memset(gTileAtlasSlot, 0, sizeof(gTileAtlasSlot));
+	for (size_t i = 0; i < sizeof(kTileTextures) / sizeof(kTileTextures[0]); i++) {
+		const ptrdiff_t slot = kTileTextures[i].texnam - gTextureNames;
+		if (slot <= 0 || slot >= 256)
+			continue;
+		for (int tileID = 1; tileID < 256; tileID++)
+			if (gTextureNames[tileID] == gTextureNames[slot])
+				gTileAtlasSlot[tileID] = slot;
+	}
+}
+
+// Upload an atlas's staging copy (w by h RGBA texels) to texnam, in the
+// cheapest format within maxError. Count it in gTexMemory if counted.
+static void uploadAtlasImg(const uint32_t texnam, const int w, const int h,
+	const char *const img, const int maxError, const bool counted) {
+	setTexKind(texnam, imgKind(img, (size_t)w * h, true));
+#ifndef MACOSX
+	if (gQuads)
+		return gQuads->texImage(texnam, w, h, img, true);
+#endif
+	glsBindTexture(texnam);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	const enum texFormat f = texImagePacked(w, h, img, true, maxError);
+	glCheck();
+	if (counted)
+		countTexMemory(f, (size_t)w * h, true, 1);
+	if (texnam == gTileAtlas)
+		fprintf(stderr, "DEBUG: tile atlas is %s\n", kTexFormats[f].name);
+}
+
+// Upload the tile and object textures, plus the tile and font atlases. Their
+// files are read in one batch, instead of one blocking open/read/close each.
+static void uploadStartupTextures(void) {
+	gTileAtlasImg = nnmalloc(ATLAS_SIZE * ATLAS_SIZE * 4);
+	for (size_t i = 0; i < ATLAS_SIZE * ATLAS_SIZE; i++)
+		memcpy(gTileAtlasImg + i * 4, "\0\0\0\xff", 4);
+	gFontAtlasImg = calloc(FONT_COLS * FONT_ROWS, GLYPH_SIZE * GLYPH_SIZE * 4);
+	must(gFontAtlasImg != NULL);
+	
+	genTextures(2, gMessageBgs);
+	texUpload *uploads;
+	const size_t n = listStartupTextures(&uploads);
+	initGLTextureNams(uploads, n,
+		sizeof(kTileTextures) / sizeof(kTileTextures[0]));
+	free(uploads);
+	
+	genTextures(1, &gFontAtlas);
+	uploadAtlasImg(gFontAtlas, FONT_COLS * GLYPH_SIZE, FONT_ROWS * GLYPH_SIZE,
+		gFontAtlasImg, gTexError, true);
+	free(gFontAtlasImg);
+	gFontAtlasImg = NULL;
+	
+	if (!gQuads) {  // which draws the tiles from their own textures
+		glGenTextures(1, &gTileAtlas);
+		// its tiles are already in their formats, which it has to hold exactly
+		uploadAtlasImg(gTileAtlas, ATLAS_SIZE, ATLAS_SIZE, gTileAtlasImg, 0,
+			gStaticTilemaps);
+	}
+	free(gTileAtlasImg);
+	gTileAtlasImg = NULL;
+	
+	mapTileAtlasSlots();
+	if (!gQuads)
+		printTexMemory();
 }
 
 // Initialize stl_tux. Must run exactly once.
 static void initialize(void) {
+	const int64_t start = monotonicNS();
 #ifndef MACOSX
 	findSelfOnLinux();
 #endif
+	vfsInit();
+	const char *const interpolate = getenv("STL_PLAYER_INTERPOLATE");
+	gInterpolate = !interpolate || atoi(interpolate);
+	if (!gInterpolate)
+		fprintf(stderr, "DEBUG: drawing between ticks disabled\n");
+	const char *const texError = getenv("STL_PLAYER_TEX_ERROR");
+	if (texError)
+		gTexError = atoi(texError);
 	
+	initialize_snapshots();
+#ifndef MACOSX
+	gQuads = usingSoftRenderer() ? &gSoftRenderer :
+		usingGL33Renderer() ? &gGL33Renderer : NULL;
+	if (gQuads)
+		gQuads->init();
+	else {
+#ifndef NDEBUG
+		initialize_gl_debug();
+#endif
+		traceStart();
+		initialize_prgm();
+		// (the loader's uploads would be missing from a trace)
+		gTexLoader = !tracing() && texLoaderStart();
+		if (gTexLoader)
+			genTextures(1, &gBackgroundLoad.texnam);
+	}
+#else
 	initialize_prgm();
+#endif
+	const int64_t prgmEnd = monotonicNS();
+	initialize_batch();
+#ifndef MACOSX
+	initialize_scene();
+	initialize_depth();
+#endif
 	maybeInitgTextureNames();
-	
 	assert(populateGOTN());
+	listAlphaTextures();
+	uploadStartupTextures();
+	const int64_t texturesEnd = monotonicNS();
 	
 	const char *const kStartingLevel = "gpl/levels/level1.stl";
 	assert(loadLevel(kStartingLevel));  // xxx
 	gCurrLevel = 1;  // hack for debugging xxx
+	const int64_t end = monotonicNS();
+	fprintf(stderr, "DEBUG: startup took %.1f ms: %.1f ms to the program, "
+		"%.1f ms textures, %.1f ms level\n", (end - start) / 1e6,
+		(prgmEnd - start) / 1e6, (texturesEnd - prgmEnd) / 1e6,
+		(end - texturesEnd) / 1e6);
+}
+
+#ifndef MACOSX
+// Entry point for `stl_player --bench-io`. Time the startup texture reads.
+bool benchAssets(void) {
+	findSelfOnLinux();
+	vfsInit();
+	listAlphaTextures();
 	
-	assert(loadLevelBackground());
-	
-	initialize_alphatiles();
+	texUpload *uploads;
+	const size_t n = listStartupTextures(&uploads);
+	asset *const assets = nnmalloc(n * sizeof(asset));
+	for (size_t i = 0; i < n; i++)
+		assets[i].path = uploads[i].imgnam;
+	benchAssetIO(assets, n);
+	free(assets);
+	free(uploads);
+	return true;
 }
+#endif
 
 // Return true if w is completely off-screen.
 static bool isOffscreen(const WorldItem *const w) {
@@ -1771,7 +3248,112 @@ static bool isOffscreen(const WorldItem *const w) {
 		leftOf(w) > gWindowWidth || rightOf(w) < 0);
 }
 
-// Draw the vertices with texnam. (The vertex shader will NOT flip y.)
+// Create the streaming vertex buffer and the (static) quad index buffer.
+static void initialize_batch(void) {
+	gBatch.disabled = getenv("STL_PLAYER_NO_BATCH") != NULL;
+	if (gBatch.disabled)
+		fprintf(stderr, "DEBUG: sprite batching disabled\n");
+	gStaticTilemaps = getenv("STL_PLAYER_NO_STATIC_TM") == NULL;
+	if (!gStaticTilemaps)
+		fprintf(stderr, "DEBUG: static tilemap buffers disabled\n");
+	gTMChunks = getenv("STL_PLAYER_NO_TM_CHUNKS") == NULL;
+	if (!gTMChunks)
+		fprintf(stderr, "DEBUG: tilemap chunk textures disabled\n");
+	if (gQuads) {  // tiles go through the batcher, like everything else
+		gStaticTilemaps = false;
+		return;
+	}
+	
+	uint16_t *const indices = nnmalloc(BATCH_MAX_QUADS * 6 * sizeof(uint16_t));
+	for (int q = 0; q < BATCH_MAX_QUADS; q++) {  // same order as a tri strip
+		indices[q * 6 + 0] = q * 4 + 0;
+		indices[q * 6 + 1] = q * 4 + 1;
+		indices[q * 6 + 2] = q * 4 + 2;
+		indices[q * 6 + 3] = q * 4 + 2;
+		indices[q * 6 + 4] = q * 4 + 1;
+		indices[q * 6 + 5] = q * 4 + 3;
+	}
+	glGenBuffers(1, &gBatch.vbo);
+	glGenBuffers(1, &gBatch.ibo);
+#ifndef MACOSX
+	glGenFramebuffers(1, &gChunkFbo);
+#endif
+	glsBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBatch.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		BATCH_MAX_QUADS * 6 * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+	free(indices);
+	glCheck();
+}
+
+struct batchKey {
+	uint32_t kind;
+	uint32_t texnam;
+	uint32_t idx;
+};
+
+static int cmpForBatchKey(const void *p, const void *q) {
+	const struct batchKey *const a = p, *const b = q;
+	if (a->kind != b->kind)  // opaque ones first, translucent ones last
+		return a->kind > b->kind ? -1 : 1;
+	if (a->texnam != b->texnam)
+		return a->texnam < b->texnam ? -1 : 1;
+	return a->idx < b->idx ? -1 : a->idx > b->idx;  // keep the sort stable
+}
+
+// Group the queued quads by kind, then texture. Only valid when none of them
+// overlap.
+static void batchSort(void) {
+	static struct batchKey keys[BATCH_MAX_QUADS];
+	static float verts[BATCH_MAX_QUADS * 16];
+	for (size_t i = 0; i < gBatch.len; i++)
+		keys[i] = (struct batchKey){ texKind(gBatch.texnams[i]),
+			gBatch.texnams[i], i };
+	qsort(keys, gBatch.len, sizeof(keys[0]), cmpForBatchKey);
+	for (size_t i = 0; i < gBatch.len; i++) {
+		memcpy(&verts[i * 16], &gBatch.verts[keys[i].idx * 16],
+			16 * sizeof(float));
+		gBatch.texnams[i] = keys[i].texnam;
+	}
+	memcpy(gBatch.verts, verts, gBatch.len * 16 * sizeof(float));
+}
+
+// Draw every queued quad. Pass sortByTexture only if the quads queued since the
+// last flush cannot overlap (e.g. they are all from one tilemap layer).
+static void batchFlush(bool sortByTexture) {
+	if (gBatch.len == 0)
+		return;
+	if (sortByTexture)
+		batchSort();
+#ifndef MACOSX
+	if (gQuads) {
+		gQuads->queueQuads(gBatch.verts, gBatch.texnams, gBatch.len);
+		gRenderStats.quads += gBatch.len;
+		gBatch.len = 0;
+		return;
+	}
+#endif
+	
+	glsBindBuffer(GL_ARRAY_BUFFER, gBatch.vbo);
+	GLS(glBufferData(GL_ARRAY_BUFFER, gBatch.len * 16 * sizeof(float),
+		gBatch.verts, GL_STREAM_DRAW));  // orphans last flush's storage
+	glsVertexAttribPointer((const void *)0);
+	glsBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gBatch.ibo);
+	
+	for (size_t start = 0; start < gBatch.len;) {
+		size_t end = start + 1;
+		while (end < gBatch.len && gBatch.texnams[end] == gBatch.texnams[start])
+			end++;
+		glsTexKind(texKind(gBatch.texnams[start]));
+		glsBindTexture(gBatch.texnams[start]);
+		glsDrawQuads(start, end - start);
+		start = end;
+	}
+	gRenderStats.quads += gBatch.len;
+	gBatch.len = 0;
+}
+
+// Queue the vertices to be drawn with texnam. (The vertex shader will NOT flip
+// y.) The quad reaches the screen at the next batchFlush().
 static void drawGLvertices(const float *const vertices, const uint32_t texnam) {
 	const float vec2Vertices[] = {
 		vertices[0], vertices[1],	0.0001, 0.0001,
@@ -1779,28 +3361,82 @@ static void drawGLvertices(const float *const vertices, const uint32_t texnam) {
 		vertices[6], vertices[7],	0.9999, 0.0001,
 		vertices[9], vertices[10],	0.9999, 0.9999,
 	};
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, vec2Vertices);
-	glEnableVertexAttribArray(0);
-	glBindAttribLocation(prgm, 0, "verticesAndTexcoords");
-	
-	assert(glGetError() == GL_NO_ERROR);
+	batchQuad(vec2Vertices, texnam);
+}
 
-	glBindTexture(GL_TEXTURE_2D, texnam);
+// Queue a quad given as x, y, s, t for each vertex (in the batch's layout).
+static void batchQuad(const float *const quad, const uint32_t texnam) {
+	if (gBatch.len == BATCH_MAX_QUADS)
+		batchFlush(false);
 	
-	static bool firstRun = true;
-	if (firstRun) {
-		firstRun = false;
-		glLinkProgram(prgm);
-	}
+	memcpy(&gBatch.verts[gBatch.len * 16], quad, 16 * sizeof(float));
+	gBatch.texnams[gBatch.len++] = texnam;
+	
+	if (gBatch.disabled)
+		batchFlush(false);
+}
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	must(glGetError() == GL_NO_ERROR);
+// Print the average per-frame rendering counters since the last call.
+void printRenderStats(void) {
+	const uint64_t frames = gRenderStats.frames > 0 ? gRenderStats.frames : 1;
+	fprintf(stderr, "DEBUG: per frame: %.1f draw calls, %.1f quads, "
+		"%.1f GL calls (%.1f skipped), %.1f us submit, %llu chunks built, "
+		"%llu messages built, %.1f of %.1f items drawn\n",
+		(double)gRenderStats.drawCalls / frames,
+		(double)gRenderStats.quads / frames,
+		(double)gRenderStats.glCalls / frames,
+		(double)gRenderStats.glCallsSkipped / frames,
+		gRenderStats.submit_ns / 1000.0 / frames,
+		(long long unsigned)gRenderStats.chunksBuilt,
+		(long long unsigned)gRenderStats.messagesBuilt,
+		(double)gRenderStats.itemsDrawn / frames,
+		(double)gRenderStats.itemsVisited / frames);
+	snapLock();
+	const struct simStats sim = gSimStats;
+	memset(&gSimStats, 0, sizeof(gSimStats));
+	snapUnlock();
+	fprintf(stderr, "DEBUG: sim: %llu ticks (%llu late), %.1f us/tick, "
+		"%.1f ms CPU, %llu snapshots never drawn\n",
+		(long long unsigned)sim.ticks, (long long unsigned)sim.late,
+		sim.ticks ? sim.tick_ns / 1000.0 / sim.ticks : 0.0,
+		sim.cpu_ns / 1e6, (long long unsigned)sim.dropped);
+	memset(&gRenderStats, 0, sizeof(gRenderStats));
 }
 
-// Draw WorldItems.
-static void drawWorldItems(void) {
-	for (size_t i = 0; i < gBuckets_len; i++)
+// Queue the vertices to be drawn with texnam in the snapshot being filled in.
+// (Same layout as for drawGLvertices().) They moved by dx, dy in the tick.
+static void snapQuad(const float *const vertices, const uint32_t texnam,
+	const int dx, const int dy) {
+	struct frameSnapshot *const snap = &gSnaps[gSnapBack];
+	if (snap->nSprites == SNAP_MAX_SPRITES) {
+		fprintf(stderr, "DEBUG: snapshot full, sprite dropped\n");
+		return;
+	}
+	struct sprite *const sp = &snap->sprites[snap->nSprites++];
+	for (int v = 0; v < 4; v++) {
+		sp->xy[v * 2] = vertices[v * 3];
+		sp->xy[v * 2 + 1] = vertices[v * 3 + 1];
+	}
+	// a jump (a respawn, a kick) is shown as it is
+	const bool jumped = abs(dx) > 2 * TILE_WIDTH || abs(dy) > 2 * TILE_HEIGHT;
+	sp->motion[0] = jumped ? 0 : dx;
+	sp->motion[1] = jumped ? 0 : -dy;
+	sp->texnam = texnam;
+}
+
+// Draw WorldItems (into the snapshot being filled in).
+// Only the buckets that can hold something on screen are walked. Positions are
+// in window coordinates, so whatever is left of the screen is in bucket 0, and
+// nothing in a bucket starting past the right edge (plus a margin, for big
+// sprites) can be visible. Return how many WorldItems were looked at.
+static size_t drawWorldItems(void) {
+	const size_t margin = 2 * TILE_WIDTH;
+	size_t end = (gWindowWidth + margin) / BUCKETS_SIZE + 1, visited = 0;
+	if (end > gBuckets_len)
+		end = gBuckets_len;
+	for (size_t i = 0; i < end; i++)
 		for (const WorldItem *w = gBuckets[i]->next; w; w = w->next) {
+			visited++;
 			if (isOffscreen(w) || w->texnam == 0)
 				continue;
 			
@@ -1810,36 +3446,66 @@ static void drawWorldItems(void) {
 				w->x + w->width,	gWindowHeight - w->y,				1.0,
 				w->x + w->width,	gWindowHeight - w->y - w->height,	1.0,
 			};
-			drawGLvertices(vertices, w->texnam);
+			snapQuad(vertices, w->texnam, w->x - w->prevX, w->y - w->prevY);
 		}
+	return visited;
 }
 
-// Draw the level background.
-static void drawLevelBackground(void) {
+// Draw the level background. It wraps around every window width, so with
+// GL_REPEAT it takes one quad; blending is only needed if it has transparency.
+static void drawLevelBackground(const int scrollOffset) {
+	if (gBackgroundTexnam == gTextureNames[0])
+		return;  // no background, nothing but the clear color
+	if (gBackgroundRepeats && !gQuads) {
+		const float s0 = (float)(scrollOffset % gWindowWidth) / gWindowWidth;
+		const float quad[] = {
+			0,				gWindowHeight,	s0,		0,
+			0,				0,				s0,		1,
+			gWindowWidth,	gWindowHeight,	s0 + 1,	0,
+			gWindowWidth,	0,				s0 + 1,	1,
+		};
+		batchQuad(quad, gBackgroundTexnam);
+		return batchFlush(false);
+	}
+	
+	// otherwise (e.g. in a quad renderer) split it where it wraps
 	float backgroundVertices[] = {
-		0 - gScrollOffset % gWindowWidth,				gWindowHeight,	1.0,
-		0 - gScrollOffset % gWindowWidth,				0,				1.0,
-		gWindowWidth - gScrollOffset % gWindowWidth,	gWindowHeight,	1.0,
-		gWindowWidth - gScrollOffset % gWindowWidth,	0,				1.0,
+		0 - scrollOffset % gWindowWidth,				gWindowHeight,	1.0,
+		0 - scrollOffset % gWindowWidth,				0,				1.0,
+		gWindowWidth - scrollOffset % gWindowWidth,	gWindowHeight,	1.0,
+		gWindowWidth - scrollOffset % gWindowWidth,	0,				1.0,
 	};
-	drawGLvertices(backgroundVertices, gTextureNames[256]);
+	drawGLvertices(backgroundVertices, gBackgroundTexnam);
 	
 	// if the previous draw doesn't cover the entire screen
-	if (gScrollOffset % gWindowWidth != 0) {
-		backgroundVertices[0] = gWindowWidth - gScrollOffset % gWindowWidth;
-		backgroundVertices[3] = gWindowWidth - gScrollOffset % gWindowWidth;
-		backgroundVertices[6] = 2 * gWindowWidth - gScrollOffset % gWindowWidth;
-		backgroundVertices[9] = 2 * gWindowWidth - gScrollOffset % gWindowWidth;
-		drawGLvertices(backgroundVertices, gTextureNames[256]);
+	if (scrollOffset % gWindowWidth != 0) {
+		backgroundVertices[0] = gWindowWidth - scrollOffset % gWindowWidth;
+		backgroundVertices[3] = gWindowWidth - scrollOffset % gWindowWidth;
+		backgroundVertices[6] = 2 * gWindowWidth - scrollOffset % gWindowWidth;
+		backgroundVertices[9] = 2 * gWindowWidth - scrollOffset % gWindowWidth;
+		drawGLvertices(backgroundVertices, gBackgroundTexnam);
 	}
 }
 
-// Clear the entire screen with a solid color.
-static void clearScreen(void) {
-	//glClearColor(30.0/255, 85.0/255, 150.0/255, 1);  // light blue
-	glClearColor(0, 0, 0, 1);
-	glClear(GL_COLOR_BUFFER_BIT);
-	drawLevelBackground();
+// Clear the entire screen with a solid color, unless the background is going
+// to cover it anyway.
+static void clearScreen(const int scrollOffset) {
+#ifndef MACOSX
+	if (gQuads)
+		gQuads->clear(0xff000000);
+	else
+#endif
+	if (!gBackgroundOpaque || !gBackgroundRepeats || !gViewportFillsWindow) {
+		//glClearColor(30.0/255, 85.0/255, 150.0/255, 1);  // light blue
+		GLS(glClearColor(0, 0, 0, 1));
+		glsDepthMask(true);  // glClear() only clears what can be written
+		GLS(glClear(GL_COLOR_BUFFER_BIT | (gEarlyZ ? GL_DEPTH_BUFFER_BIT : 0)));
+	} else if (gEarlyZ) {
+		glsDepthMask(true);
+		GLS(glClear(GL_DEPTH_BUFFER_BIT));
+	}
+	if (!gEarlyZ)  // otherwise it is drawn behind the opaque tiles
+		drawLevelBackground(scrollOffset);
 }
 
 // Select the furthest reset point the tux has passed in the level.
@@ -1885,8 +3551,6 @@ static void reloadLevel(bool ignoreCheckpoints) {
 	assert(loadLevel(filename));
 	free(filename);
 	
-	assert(loadLevelBackground());
-	
 	if (!ignoreCheckpoints && rp.x != -1 && rp.y != -1) {
 		if (rp.x - gWindowWidth / 3 > 0)
 			scrollTheScreen(rp.x - gWindowWidth / 3);
@@ -2043,100 +3707,177 @@ static size_t longestLine(const char *msg) {
 	return longest;
 }
 
-// Display a message on the screen.
-static void displayMessage(const char *msg, const uint32_t backgroundID) {
-	const size_t msg_width = longestLine(msg) * TILE_WIDTH / 2;
-	const size_t msg_height = (count(msg, '\n') + 1) * TILE_HEIGHT / 2;
-	
-	size_t xpos = 0;
-	if (msg_width < (size_t)gWindowWidth)
-		xpos = (gWindowWidth - msg_width) / 2;
-	size_t ypos = 0;
-	if (msg_height < (size_t)gWindowHeight)
-		ypos = (gWindowHeight - msg_height) / 2;
-	const size_t xpos_orig = xpos;  //, ypos_orig = ypos;
-	
-	for (; *msg; msg++) {
-		const float vertices[] = {
-			xpos,					gWindowHeight - ypos,					1,
-			xpos,					gWindowHeight - ypos - TILE_HEIGHT / 2,	1,
-			xpos + TILE_WIDTH / 2,	gWindowHeight - ypos,					1,
-			xpos + TILE_WIDTH / 2,	gWindowHeight - ypos - TILE_HEIGHT / 2,	1,
-		};
-		if ((*msg >= 'a' && *msg <= 'z') || (*msg >= '0' && *msg <= '9')) {
-			drawGLvertices(vertices, alphatiles[backgroundID]);
-			drawGLvertices(vertices, alphatiles[(int)*msg]);
-			xpos += TILE_WIDTH / 2;
-		} else if (*msg == ' ') {
-			drawGLvertices(vertices, alphatiles[backgroundID]);
-			xpos += TILE_WIDTH / 2;
-		} else if (*msg == '\n') {
-			xpos = xpos_orig;
-			ypos += TILE_HEIGHT / 2;
-		} else
-			fprintf(stderr, "DEBUG: unimplemented alphatile character '%c'\n",
-				*msg);
-	}
+// Display a message on the screen (over everything else in the snapshot).
+// Only a-z, 0-9, spaces and newlines can be shown.
+static void displayMessage(const char *msg, const int backgroundGlyph) {
+	struct frameSnapshot *const snap = &gSnaps[gSnapBack];
+	snprintf(snap->message, sizeof(snap->message), "%s", msg);
+	snap->messageBg = backgroundGlyph;
 }
 
 static void displayDeathMessage(void) {
-	displayMessage("you died\nplease press enter", 255);
+	displayMessage("you died\nplease press enter", GLYPH_RED);
 }
 
 static void displayPassMessage(void) {
-	const char *const prefix = "level complete\n";
-	const char *const suffix = " deaths\nplease press enter";
-	char *msg = nnmalloc(strlen(prefix) + intAsStrLen(gNDeaths) +
-		strlen(suffix) + 1);
-	strcpy(msg, prefix);
-	sprintf(msg + strlen(prefix), "%d", gNDeaths);
-	msg[strlen(prefix) + intAsStrLen(gNDeaths)] = '\0';
-	strcat(msg, suffix);
-	
-	displayMessage(msg, 254);
-	
-	free(msg);
+	char msg[SNAP_MESSAGE_LEN];
+	snprintf(msg, sizeof(msg), "level complete\n%d deaths\nplease press enter",
+		gNDeaths);
+	displayMessage(msg, GLYPH_GREEN);
 }
 
 void setGLViewport(
 	const int *const pResolutionWidth,
 	const int *const pResolutionHeight)
 {
+	int viewport[4];
 	if (*pResolutionWidth < *pResolutionHeight) {
 		const int scaledHeight = *pResolutionWidth * 3.0 / 4;
-		glViewport(
-			0,
-			(*pResolutionHeight - scaledHeight) / 2,
-			*pResolutionWidth,
-			scaledHeight
-		);
+		viewport[0] = 0;
+		viewport[1] = (*pResolutionHeight - scaledHeight) / 2;
+		viewport[2] = *pResolutionWidth;
+		viewport[3] = scaledHeight;
 	} else {  // width >= height
 		const int scaledWidth = *pResolutionHeight * 4.0 / 3;
-		glViewport(
-			(*pResolutionWidth - scaledWidth) / 2,
-			0,
-			scaledWidth,
-			*pResolutionHeight
-		);
+		viewport[0] = (*pResolutionWidth - scaledWidth) / 2;
+		viewport[1] = 0;
+		viewport[2] = scaledWidth;
+		viewport[3] = *pResolutionHeight;
 	}
+	if (gQuads) {
+		if (gQuads->viewport)
+			gQuads->viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		return;
+	}
+	glsViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	gViewportFillsWindow = gGLState.viewport[2] == *pResolutionWidth &&
+		gGLState.viewport[3] == *pResolutionHeight;
 }
 
-// Core game loop. Runs everything else. Called by draw().
-void core(
-	keys *const k,
-	bool runPhysics,
-	const int *const pResolutionWidth,
-	const int *const pResolutionHeight)
-{
-	setGLViewport(pResolutionWidth, pResolutionHeight);
-	
-	static bool initialized = false;
-	if (!initialized) {
-		initialize();
-		initialized = true;
+// STL_PLAYER_INTERNAL_SCALE=n draws frames at n times 640x480 into
+// gSceneTexnam, whatever the window size, and then scales that up to the
+// window with one nearest-neighbor quad.
+static int gInternalScale;  // 0: draw straight into the window
+static uint32_t gSceneTexnam;
+static int gWindowViewport[4];
+static bool gSceneFillsWindow;
+
+#ifndef MACOSX
+static void initialize_scene(void) {
+	const char *const scale = getenv("STL_PLAYER_INTERNAL_SCALE");
+	gInternalScale = scale ? atoi(scale) : 0;
+	if (gInternalScale <= 0 || gQuads) {
+		gInternalScale = 0;
+		return;
 	}
+	fprintf(stderr, "DEBUG: drawing at %dx%d, then scaling up\n",
+		gWindowWidth * gInternalScale, gWindowHeight * gInternalScale);
 	
+	glGenTextures(1, &gSceneTexnam);
+	glsBindTexture(gSceneTexnam);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, gWindowWidth * gInternalScale,
+		gWindowHeight * gInternalScale, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &gSceneFbo);
+	glsBindFramebuffer(gSceneFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+		gSceneTexnam, 0);
+	must(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glsBindFramebuffer(0);
+	setTexKind(gSceneTexnam, TEX_OPAQUE);  // whatever its alpha, replace
+	glCheck();
+}
+
+// STL_PLAYER_EARLY_Z=1 turns on paintLayersEarlyZ(), if what frames are drawn
+// into has (or, for gSceneFbo, can be given) a depth buffer.
+static void initialize_depth(void) {
+	const char *const earlyZ = getenv("STL_PLAYER_EARLY_Z");
+	if (!earlyZ || !atoi(earlyZ) || gQuads || !gStaticTilemaps)
+		return;
+	int depthBits = 0;
+	glGetIntegerv(GL_DEPTH_BITS, &depthBits);
+	if (gInternalScale) {
+		uint32_t depthRb;
+		glGenRenderbuffers(1, &depthRb);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRb);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16,
+			gWindowWidth * gInternalScale, gWindowHeight * gInternalScale);
+		glsBindFramebuffer(gSceneFbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			GL_RENDERBUFFER, depthRb);
+		must(glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+			GL_FRAMEBUFFER_COMPLETE);
+		glsBindFramebuffer(0);
+		depthBits = 16;
+	}
+	if (depthBits <= 0) {
+		fprintf(stderr, "DEBUG: no depth buffer, so no early-Z\n");
+		return;
+	}
+	gEarlyZ = true;
+	glDepthFunc(GL_LESS);
+	glCheck();
+	fprintf(stderr, "DEBUG: early-Z with a %d-bit depth buffer\n", depthBits);
+}
+#endif
+
+// Set the viewport for a frame: the window's, or gSceneFbo's whole texture.
+static void beginScene(const int *const pResolutionWidth,
+	const int *const pResolutionHeight) {
+	setGLViewport(pResolutionWidth, pResolutionHeight);
+	if (!gInternalScale)
+		return;
+#ifndef MACOSX
+	memcpy(gWindowViewport, gGLState.viewport, sizeof(gWindowViewport));
+	gSceneFillsWindow = gViewportFillsWindow;
+	gViewportFillsWindow = true;
+	glsBindFramebuffer(gSceneFbo);
+	glsViewport(0, 0, gWindowWidth * gInternalScale,
+		gWindowHeight * gInternalScale);
+#endif
+}
+
+// Put the frame drawn since beginScene() in the window.
+static void endScene(void) {
+	if (!gInternalScale)
+		return;
+#ifndef MACOSX
+	glsBindFramebuffer(0);
+	glsViewport(gWindowViewport[0], gWindowViewport[1], gWindowViewport[2],
+		gWindowViewport[3]);
+	if (!gSceneFillsWindow) {  // the letterboxing
+		GLS(glClearColor(0, 0, 0, 1));
+		GLS(glClear(GL_COLOR_BUFFER_BIT));
+	}
+	const float quad[] = {  // the texture's rows go bottom-up
+		0,				gWindowHeight,	0, 1,
+		0,				0,				0, 0,
+		gWindowWidth,	gWindowHeight,	1, 1,
+		gWindowWidth,	0,				1, 0,
+	};
+	batchQuad(quad, gSceneTexnam);
+	batchFlush(false);
+#endif
+}
+
+// Note where everything is before a tick moves it, so the renderer can draw
+// the tick's motion in between.
+static void rememberPositions(void) {
+	for (size_t i = 0; i < gBuckets_len; i++)
+		for (WorldItem *w = gBuckets[i]->next; w; w = w->next) {
+			w->prevX = w->x;
+			w->prevY = w->y;
+		}
+	gPrevScrollOffset = gScrollOffset;
+}
+
+// Run one tick of the game, and fill in the next snapshot with its result.
+static void simulate(keys *const k, bool runPhysics) {
 	verifyBuckets();
+	rememberPositions();
 	
 	if (runPhysics) {
 		processInput(k);
@@ -2145,11 +3886,30 @@ void core(
 		applyGravity();
 	}
 	
-	clearScreen();
-	paintTM(lvl.backgroundtm);
-	paintTM(lvl.interactivetm);
-	drawWorldItems();
-	paintTM(lvl.foregroundtm);
+	static uint64_t tick = 0;
+	struct frameSnapshot *const snap = &gSnaps[gSnapBack];
+	snap->tick = ++tick;
+	snap->levelGen = gLevelGen;
+	snap->scrollOffset = gScrollOffset;
+	snap->prevScrollOffset = gScrollOffset - gPrevScrollOffset > TILE_WIDTH ||
+		gScrollOffset < gPrevScrollOffset ? gScrollOffset : gPrevScrollOffset;
+	snap->firstCol = snap->prevScrollOffset / TILE_WIDTH;
+	snap->nCols = SNAP_COLS;
+	if (snap->firstCol + snap->nCols > lvl.width)
+		snap->nCols = lvl.width - snap->firstCol;
+	memset(snap->tiles, 0, sizeof(snap->tiles));
+	uint8_t **const tms[TM_NLAYERS] = {
+		lvl.backgroundtm, lvl.interactivetm, lvl.foregroundtm,
+	};
+	for (int i = 0; i < TM_NLAYERS; i++)
+		for (int h = 0; h < lvl.height; h++)
+			for (int c = 0; c < snap->nCols; c++)
+				snap->tiles[i][h][c] = tms[i][h][snap->firstCol + c];
+	snap->nSprites = 0;
+	snap->message[0] = '\0';
+	snap->nItemsVisited = drawWorldItems();
+	snap->nWorldSprites = snap->nSprites;
+	
 	if (tux->type == STL_TUX_DEAD) {  // reload the current level
 		displayDeathMessage();
 		displayingMessage = true;
@@ -2169,6 +3929,338 @@ void core(
 			reloadLevel(true);
 		}
 	}
+}
+
+// simulate(), then publish the snapshot. The next tick is period ns away, or
+// 0 if the snapshot is drawn right away and should be drawn as it is.
+static void simulateAndPublish(keys *const k, bool runPhysics,
+	const int64_t period) {
+	struct timespec start, end;
+	assert(TIME_UTC == timespec_get(&start, TIME_UTC));
+	simulate(k, runPhysics);
+	gSnaps[gSnapBack].time = monotonicNS();
+	gSnaps[gSnapBack].period = gInterpolate ? period : 0;
+	assert(TIME_UTC == timespec_get(&end, TIME_UTC));
+	publishSnapshot((end.tv_sec - start.tv_sec) * (int64_t)NSONE +
+		end.tv_nsec - start.tv_nsec);
+}
+
+// How far the time is into snap's tick: 0 just as it ran, 1 (at most) once
+// the next one is due, and 1 for a snapshot that is drawn as it is.
+static float tickFraction(const struct frameSnapshot *const snap) {
+	if (snap->period <= 0)
+		return 1;
+	const float f = (float)(monotonicNS() - snap->time) / snap->period;
+	return f < 0 ? 0 : f > 1 ? 1 : f;
+}
+
+// a + (b - a) * f, rounded to whole pixels the same way everywhere, so what
+// stands still in the level moves with the tiles.
+static int lerpPixels(const int a, const int b, const float f) {
+	return a + (int)lroundf((b - a) * f);
+}
+
+// Draw the sprites [begin, end) of snap, gDrawFraction of the way from where
+// they were when the tick began to where it left them.
+static void drawSprites(const struct frameSnapshot *const snap,
+	const size_t begin, const size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		const float *const xy = snap->sprites[i].xy;
+		const int *const m = snap->sprites[i].motion;
+		const float dx = lerpPixels(-m[0], 0, gDrawFraction);
+		const float dy = lerpPixels(-m[1], 0, gDrawFraction);
+		const float vertices[] = {
+			xy[0] + dx, xy[1] + dy, 1.0,
+			xy[2] + dx, xy[3] + dy, 1.0,
+			xy[4] + dx, xy[5] + dy, 1.0,
+			xy[6] + dx, xy[7] + dy, 1.0,
+		};
+		drawGLvertices(vertices, snap->sprites[i].texnam);
+	}
+}
+
+// Queue glyph g, w by h with its top left corner at x, y.
+static void queueGlyph(const int g, const float x, const float y,
+	const float w, const float h) {
+	if (g >= GLYPH_RED) {
+		const float quad[] = {
+			x,		y,		0, 0,
+			x,		y - h,	0, 1,
+			x + w,	y,		1, 0,
+			x + w,	y - h,	1, 1,
+		};
+		batchQuad(quad, gMessageBgs[g - GLYPH_RED]);
+		return;
+	}
+	const int col = g % FONT_COLS, row = g / FONT_COLS;
+	const float s0 = (col + 0.0001) / FONT_COLS, s1 = (col + 0.9999) / FONT_COLS;
+	const float t0 = (row + 0.0001) / FONT_ROWS, t1 = (row + 0.9999) / FONT_ROWS;
+	const float quad[] = {
+		x,		y,		s0, t0,
+		x,		y - h,	s0, t1,
+		x + w,	y,		s1, t0,
+		x + w,	y - h,	s1, t1,
+	};
+	batchQuad(quad, gFontAtlas);
+}
+
+// Queue the glyphs of msg, each w by h, from the top left corner x, y. The
+// backgrounds all go first, then the characters over them, so that each
+// texture is one run of the batch.
+static void queueMessage(const char *const msg, const int bg, const float x,
+	const float y, const float w, const float h) {
+	for (int pass = 0; pass < 2; pass++) {
+		float cx = x, cy = y;
+		for (const char *c = msg; *c; c++) {
+			if ((*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9')) {
+				queueGlyph(pass == 0 ? bg : *c <= '9' ? GLYPH_DIGITS + *c - '0' :
+					*c - 'a', cx, cy, w, h);
+				cx += w;
+			} else if (*c == ' ') {
+				if (pass == 0)
+					queueGlyph(bg, cx, cy, w, h);
+				cx += w;
+			} else if (*c == '\n') {
+				cx = x;
+				cy -= h;
+			} else if (pass == 0)
+				fprintf(stderr, "DEBUG: unimplemented alphatile character '%c'\n",
+					*c);
+		}
+	}
+}
+
+#ifndef MACOSX
+// The message last drawn, in a texture of its own (premultiplied, at the
+// viewport's resolution), so a frame showing it costs one quad.
+static struct {
+	char text[SNAP_MESSAGE_LEN];
+	int bg;
+	uint32_t texnam;
+	int width, height;  // texels
+} gMessage;
+
+// Draw a message of nCols by nRows characters into gMessage, unless it already
+// holds it. Return false if it is too big for a texture.
+static bool buildMessage(const char *const msg, const int bg, const int nCols,
+	const int nRows) {
+	const int w = nCols * TILE_WIDTH / 2 * gGLState.viewport[2] / gWindowWidth;
+	const int h = nRows * TILE_HEIGHT / 2 * gGLState.viewport[3] /
+		gWindowHeight;
+	if (gMessage.texnam && gMessage.bg == bg && !strcmp(gMessage.text, msg) &&
+		gMessage.width == w && gMessage.height == h)
+		return true;
+	int maxSize;
+	GLS(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize));
+	if (w <= 0 || h <= 0 || w > maxSize || h > maxSize)
+		return false;
+	batchFlush(false);  // the batch is about to draw into gChunkFbo
+	const int viewport[4] = { gGLState.viewport[0], gGLState.viewport[1],
+		gGLState.viewport[2], gGLState.viewport[3] };
+	
+	if (!gMessage.texnam) {
+		GLS(glGenTextures(1, &gMessage.texnam));
+		setTexKind(gMessage.texnam, TEX_TRANSLUCENT);
+		glsBindTexture(gMessage.texnam);
+		GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+		GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+		GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+		GLS(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	}
+	glsBindTexture(gMessage.texnam);
+	GLS(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA,
+		GL_UNSIGNED_BYTE, NULL));
+	glsBindFramebuffer(gChunkFbo);
+	GLS(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, gMessage.texnam, 0));
+	must(GLS(glCheckFramebufferStatus(GL_FRAMEBUFFER)) ==
+		GL_FRAMEBUFFER_COMPLETE);
+	
+	glsViewport(0, 0, w, h);
+	const bool depthTest = gGLState.depthTest == 1;  // gChunkFbo has no depth
+	glsDepthTest(false);
+	GLS(glClearColor(0, 0, 0, 0));
+	GLS(glClear(GL_COLOR_BUFFER_BIT));
+	glsBlendFunc(BLEND_ACCUMULATE);
+	queueMessage(msg, bg, 0, gWindowHeight, (float)gWindowWidth / nCols,
+		(float)gWindowHeight / nRows);
+	batchFlush(false);
+	glsBlendFunc(BLEND_OVER);
+	
+	glsBindFramebuffer(gSceneFbo);
+	glsViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glsDepthTest(depthTest);
+	snprintf(gMessage.text, sizeof(gMessage.text), "%s", msg);
+	gMessage.bg = bg;
+	gMessage.width = w;
+	gMessage.height = h;
+	gRenderStats.messagesBuilt++;
+	glCheck();
+	return true;
+}
+#endif
+
+// Draw snap's message, centered, over everything else.
+static void paintMessage(const struct frameSnapshot *const snap) {
+	const char *const msg = snap->message;
+	if (!*msg)
+		return;
+	const int nCols = longestLine(msg), nRows = count(msg, '\n') + 1;
+	const int w = TILE_WIDTH / 2, h = TILE_HEIGHT / 2;
+	const int x = nCols * w < gWindowWidth ? (gWindowWidth - nCols * w) / 2 : 0;
+	const int y = gWindowHeight -
+		(nRows * h < gWindowHeight ? (gWindowHeight - nRows * h) / 2 : 0);
+#ifndef MACOSX
+	if (!gQuads && buildMessage(msg, snap->messageBg, nCols, nRows)) {
+		const float quad[] = {  // the texture's rows go bottom-up
+			x,				y,				0, 1,
+			x,				y - nRows * h,	0, 0,
+			x + nCols * w,	y,				1, 1,
+			x + nCols * w,	y - nRows * h,	1, 0,
+		};
+		batchFlush(false);
+		glsBlendFunc(BLEND_PREMULTIPLIED);
+		batchQuad(quad, gMessage.texnam);
+		batchFlush(false);
+		glsBlendFunc(BLEND_OVER);
+		return;
+	}
+#endif
+	queueMessage(msg, snap->messageBg, x, y, w, h);
+}
+
+#ifndef MACOSX
+// The depths of the layers, nearest first: the foreground tiles, the
+// interactive tiles, the background tiles, and the background. The world's
+// sprites go between the foreground and interactive tiles; see spriteDepth().
+// The overlays go on top with the depth test off. The depth buffer is cleared
+// to 1, which GL_LESS never passes.
+enum { Z_FOREGROUND, Z_INTERACTIVE, Z_BACKGROUND_TM, Z_BACKGROUND };
+static const float kLayerDepth[] = { 0.1, 0.5, 0.7, 0.9 };
+static const int kTMDepth[TM_NLAYERS] = { Z_BACKGROUND_TM, Z_INTERACTIVE,
+	Z_FOREGROUND };
+
+// The depth of world sprite j of n. Later sprites are nearer, so each one
+// covers the ones drawn before it, as it does back to front.
+static float spriteDepth(const size_t j, const size_t n) {
+	const float far = kLayerDepth[Z_INTERACTIVE];
+	const float near = kLayerDepth[Z_FOREGROUND];
+	return far - (far - near) * (j + 1) / (n + 1);
+}
+
+// Draw the world sprites of one pass of paintLayersEarlyZ(), each at its own
+// depth (and so with a draw call of its own): the opaque and cutout ones,
+// nearest first, or the translucent ones, in order.
+static void drawSpritesEarlyZ(const struct frameSnapshot *const snap,
+	const bool opaquePass) {
+	const size_t n = snap->nWorldSprites;
+	for (size_t k = 0; k < n; k++) {
+		const size_t j = opaquePass ? n - 1 - k : k;
+		if ((texKind(snap->sprites[j].texnam) != TEX_TRANSLUCENT) != opaquePass)
+			continue;
+		glsDepth(spriteDepth(j, n));
+		drawSprites(snap, j, j + 1);
+		batchFlush(false);
+	}
+}
+
+// Draw the frame, but for the overlay sprites, with the depth buffer instead
+// of back to front. The layers without translucent tiles and the opaque and
+// cutout sprites go first, front to back with depth writes, so the GPU
+// rejects the texels they hide before shading them; the background is mostly
+// hidden. The translucent layers and sprites follow, back to front over them,
+// with the depth test and no depth writes. Opaque and cutout texels come out
+// as they would have drawn back to front, and translucent ones blend over the
+// same texels.
+static void paintLayersEarlyZ(const struct frameSnapshot *const snap) {
+	bool opaque[TM_NLAYERS];
+	for (int l = 0; l < TM_NLAYERS; l++)
+		opaque[l] = gTMLayers[l].kind != TEX_TRANSLUCENT;
+	
+	batchFlush(false);
+	glsDepthTest(true);
+	glsDepthMask(true);
+	for (int l = TM_NLAYERS - 1; l >= 0; l--) {
+		if (opaque[l]) {
+			glsDepth(kLayerDepth[kTMDepth[l]]);
+			paintTM(l, snap);
+			batchFlush(false);  // (the chunks are only queued)
+		}
+		if (l == TM_FOREGROUND)
+			drawSpritesEarlyZ(snap, true);
+	}
+	glsDepth(kLayerDepth[Z_BACKGROUND]);
+	if (gBackgroundOpaque) {
+		drawLevelBackground(gDrawScroll);
+		batchFlush(false);
+	}
+	
+	glsDepthMask(false);
+	if (!gBackgroundOpaque) {
+		drawLevelBackground(gDrawScroll);
+		batchFlush(false);
+	}
+	for (int l = 0; l < TM_NLAYERS; l++) {
+		if (l == TM_FOREGROUND)
+			drawSpritesEarlyZ(snap, false);
+		if (!opaque[l]) {
+			glsDepth(kLayerDepth[kTMDepth[l]]);
+			paintTM(l, snap);
+			batchFlush(false);
+		}
+	}
+	glsDepthTest(false);
+}
+#endif
+
+// Draw the latest snapshot (see acquireSnapshot() for wait). Return false if
+// nothing was drawn. Only touches the simulation's state through snapshots.
+static bool drawSnapshot(
+	const int *const pResolutionWidth,
+	const int *const pResolutionHeight,
+	const bool wait)
+{
+	if (!acquireSnapshot(wait))
+		return false;
+	beginScene(pResolutionWidth, pResolutionHeight);  // (binds gSceneFbo)
+	const struct frameSnapshot *const snap = &gSnaps[gSnapFront];
+	gDrawFraction = tickFraction(snap);
+	gDrawScroll = lerpPixels(snap->prevScrollOffset, snap->scrollOffset,
+		gDrawFraction);
+	
+	struct timespec submitStart, submitEnd;
+	assert(TIME_UTC == timespec_get(&submitStart, TIME_UTC));
+	
+	if (gStaticTilemaps)
+		syncInteractiveTiles(snap);
+	clearScreen(gDrawScroll);
+#ifndef MACOSX
+	if (gEarlyZ)
+		paintLayersEarlyZ(snap);
+	else
+#endif
+	{
+		paintTM(TM_BACKGROUND, snap);
+		paintTM(TM_INTERACTIVE, snap);
+		drawSprites(snap, 0, snap->nWorldSprites);
+		paintTM(TM_FOREGROUND, snap);
+	}
+	drawSprites(snap, snap->nWorldSprites, snap->nSprites);
+	paintMessage(snap);
+	batchFlush(false);
+	endScene();
+#ifndef MACOSX
+	if (gQuads)
+		gRenderStats.drawCalls += gQuads->finishFrame();
+	traceFrame();
+#endif
+	
+	assert(TIME_UTC == timespec_get(&submitEnd, TIME_UTC));
+	gRenderStats.submit_ns += (submitEnd.tv_sec - submitStart.tv_sec) *
+		(int64_t)NSONE + submitEnd.tv_nsec - submitStart.tv_nsec;
+	gRenderStats.frames++;
+	gRenderStats.itemsVisited += snap->nItemsVisited;
+	gRenderStats.itemsDrawn += snap->nWorldSprites;
 	
 	// debug TODO remove me
 //	const float vertices[] = {
@@ -2195,8 +4287,31 @@ void core(
 //	fprintf(stderr, "DEBUG: glsl ver is %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 //	fprintf(stderr, "DEBUG: extensions are %s\n", glGetString(GL_EXTENSIONS));
 
-	assert(glGetError() == GL_NO_ERROR);
+	glCheck();
 	//raise(SIGKILL);
+	return true;
+}
+
+// Initialize on first use.
+static void maybeInitialize(void) {
+	static bool initialized = false;
+	if (!initialized) {
+		initialize();
+		initialized = true;
+	}
+}
+
+// Core game loop. Runs one tick of everything else, and draws it. Called by
+// draw() when there is no simulation thread.
+void core(
+	keys *const k,
+	bool runPhysics,
+	const int *const pResolutionWidth,
+	const int *const pResolutionHeight)
+{
+	maybeInitialize();
+	simulateAndPublish(k, runPhysics, 0);
+	drawSnapshot(pResolutionWidth, pResolutionHeight, false);
 }
 
 // Like strcmp(), but for struct timespec.
@@ -2219,44 +4334,148 @@ void tsadd(struct timespec *const t1, int32_t ns) {
 }
 
 #ifndef MACOSX
+// Fixed-rate tick scheduler on the monotonic clock.
+struct ticker {
+	int64_t next;  // monotonicNS() at which the next tick is due
+	int64_t period;  // ns per tick
+	int maxCatchUp;  // ticks run back to back at most; the rest are dropped
+};
+
+// STL_PLAYER_TICK_HZ (default 60) sets the tick rate; the physics is per tick,
+// so it changes the game speed too. STL_PLAYER_MAX_CATCHUP (default 5) is how
+// many ticks may run back to back after a stall before the rest are dropped.
+static struct ticker newTicker(void) {
+	struct ticker t = { monotonicNS(), NSONE / 60, 5 };
+	const char *const hz = getenv("STL_PLAYER_TICK_HZ");
+	if (hz && atoi(hz) > 0 && atoi(hz) <= 1000) {
+		t.period = NSONE / atoi(hz);
+		fprintf(stderr, "DEBUG: ticking at %d Hz\n", atoi(hz));
+	}
+	const char *const catchUp = getenv("STL_PLAYER_MAX_CATCHUP");
+	if (catchUp && atoi(catchUp) > 0)
+		t.maxCatchUp = atoi(catchUp);
+	return t;
+}
+
+// Return how many ticks are due now, and schedule the ones after them.
+static int ticksDue(struct ticker *const t) {
+	const int64_t now = monotonicNS();
+	int n = 0;
+	while (t->next <= now && n < t->maxCatchUp) {
+		t->next += t->period;
+		n++;
+	}
+	if (t->next <= now) {  // system is too slow
+		snapLock();
+		gSimStats.late += (now - t->next) / t->period + 1;
+		snapUnlock();
+		t->next = now + t->period;
+	}
+	return n;
+}
+
+static int gSwapInterval = 0;  // 0: eglSwapBuffers() does not wait for vsync
+
+// Tell the game which swap interval the platform code got, so it knows
+// whether swapping paces the frames.
+void setSwapInterval(const int interval) {
+	gSwapInterval = interval;
+	fprintf(stderr, "DEBUG: swap interval %d\n", interval);
+}
+
 // Entry point for initgl.
 bool draw(keys *const k, const int *const pResolutionWidth, const int *const pResolutionHeight) {
-	static struct timespec then = { 0 }, now = { 0 };
-	assert(TIME_UTC == timespec_get(&now, TIME_UTC));
-	if (then.tv_sec == 0) {
-		then = now;
-		while (0 == tscmp(&then, &now)) {
-			fprintf(stderr, "DEBUG: bootstraping timer ...\n");
-			assert(TIME_UTC == timespec_get(&now, TIME_UTC));
-		}
-		srand((uint32_t)now.tv_nsec);
+	static struct ticker ticker = { 0 };
+	if (ticker.period == 0) {
+		ticker = newTicker();
+		srand((uint32_t)ticker.next);
 	}
+	maybeInitialize();
 	
-	uint8_t physicsRanTimes = 0;
-	while (tscmp(&then, &now) < 0) {
-		core(k, true && !displayingMessage, pResolutionWidth, pResolutionHeight);
-		tsadd(&then, NSONE / 60);
-		physicsRanTimes++;
-		
-		if (physicsRanTimes >= 5) {  // system is too slow
-			then = now;
-			break;
-		}
-		
-		//// prevent bouncing between drawing a dummy frame and running twice
-		//if (rand() > (RAND_MAX / 3 * 2)) {  // randomly skip [2nd,+inf) draws
-			//if (physicsRanTimes > 1)
-				//fprintf(stderr, "DEBUG: randomly skipping a physics run\n");
-			//break;
-		//}
-	}
-	if (physicsRanTimes == 0) {
-		fprintf(stderr, "DEBUG: physics ran 0 times (so drawing dummy frame)\n");
-		core(k, false, pResolutionWidth, pResolutionHeight);
-	} else if (physicsRanTimes > 1)
+	int physicsRanTimes = ticksDue(&ticker);
+	if (physicsRanTimes == 0 && gSwapInterval == 0) {
+		// Without vsync nothing else waits, so sleep instead of drawing the
+		// same frame over and over.
+		sleepUntilNS(ticker.next);
+		physicsRanTimes = ticksDue(&ticker);
+	}
+	const int64_t cpuStart = threadCPUNS();
+	for (int i = 0; i < physicsRanTimes; i++)
+		simulateAndPublish(k, true && !displayingMessage, ticker.period);
+	snapLock();
+	gSimStats.cpu_ns += threadCPUNS() - cpuStart;
+	snapUnlock();
+	
+	// (no tick at all is the usual frame between ticks, drawn further along)
+	if (physicsRanTimes > 1)
 		fprintf(stderr, "DEBUG: physics ran %d times\n", physicsRanTimes);
+	drawSnapshot(pResolutionWidth, pResolutionHeight, false);
 	
 	return true;
 }
+
+// The simulation thread. See startSimulation().
+static struct {
+	thrd_t thr;
+	const keys *k;
+	mtx_t *keysMtx;
+	bool quit;  // guarded by gSnapMtx
+} gSim;
+
+// Tick the game until stopSimulation(), sleeping between ticks.
+static int runSimulation(void *p) {
+	assert(!p);
+	struct ticker ticker = newTicker();
+	for (;;) {
+		snapLock();
+		const bool quit = gSim.quit;
+		snapUnlock();
+		if (quit)
+			return 0;
+		
+		mutexLock(gSim.keysMtx);
+		keys k = *gSim.k;
+		mutexUnlock(gSim.keysMtx);
+		
+		const int64_t cpuStart = threadCPUNS();
+		for (int n = ticksDue(&ticker); n > 0; n--)
+			simulateAndPublish(&k, !displayingMessage, ticker.period);
+		snapLock();
+		gSimStats.cpu_ns += threadCPUNS() - cpuStart;
+		snapUnlock();
+		
+		sleepUntilNS(ticker.next);
+	}
+}
+
+// Initialize, then run the simulation on a thread of its own, reading *k
+// under keysMtx. Frames are then drawn with renderFrame().
+void startSimulation(const keys *const k, mtx_t *const keysMtx) {
+	maybeInitialize();
+	srand((uint32_t)monotonicNS());
+	gSim.k = k;
+	gSim.keysMtx = keysMtx;
+	gSim.quit = false;
+	gRenderThread = true;
+	must(thrd_success == thrd_create(&gSim.thr, runSimulation, NULL));
+}
+
+void stopSimulation(void) {
+	snapLock();
+	gSim.quit = true;
+	snapUnlock();
+	must(thrd_success == thrd_join(gSim.thr, NULL));
+}
+
+// Entry point for initgl's render thread. Draw the newest snapshot from the
+// simulation thread, if there is one soon. Return true if a frame was drawn.
+// With vsync, a snapshot that is still between ticks is drawn again further
+// along instead of waiting for the next one.
+bool renderFrame(const int *const pResolutionWidth,
+	const int *const pResolutionHeight) {
+	const bool wait = gSwapInterval == 0 ||
+		tickFraction(&gSnaps[gSnapFront]) >= 1;
+	return drawSnapshot(pResolutionWidth, pResolutionHeight, wait);
+}
 #endif
 
@@ -15,6 +15,7 @@
 struct WorldItem {
 	enum stl_obj_type type;
 	int x, y;
+	int prevX, prevY;  // x and y when the tick began, for drawing in between
 	int width, height;
 	int state;  // manually set
 	float speedX, speedY;
@@ -44,5 +45,53 @@ stl levelReader(const char *const);
 void stlPrinter(const stl *const lvl);
 bool draw(keys *const, const int *const, const int *const);
 void core(keys *const, bool, const int *const, const int *const);
+void printRenderStats(void);
+int tscmp(const struct timespec *const, const struct timespec *const);
+void tsadd(struct timespec *const, int32_t);
+
+// A renderer that is handed the batcher's quads (x, y, s, t for the top left,
+// bottom left, top right and bottom right vertices; y goes up, as in the GL)
+// and draws them its own way, instead of the GLES2 draw calls.
+struct quadRenderer {
+	void (*init)(void);
+	void (*terminate)(void);
+	uint32_t (*genTexture)(void);
+	// Like glTexImage2D(). texels are RGB or RGBA bytes, rows from the top.
+	void (*texImage)(const uint32_t, const int, const int, const char *const,
+		const bool);
+	void (*viewport)(const int, const int, const int, const int);  // or NULL
+	void (*clear)(const uint32_t);  // 0xAARRGGBB
+	void (*queueQuads)(const float *const, const uint32_t *const,
+		const size_t);
+	int (*finishFrame)(void);  // draw the queued quads; returns the draw calls
+};
+
+#ifndef MACOSX
+void startSimulation(const keys *const, mtx_t *const);
+void stopSimulation(void);
+bool renderFrame(const int *const, const int *const);
+void setSwapInterval(const int);
+bool usingSoftRenderer(void);
+bool usingGL33Renderer(void);
+const uint32_t *softFramebuffer(void);
+
+// A texture for texloader.c to upload: width x height texels, rows from the
+// top.
+struct texLoad {
+	uint32_t texnam;
+	int width, height;
+	const void *texels;
+	GLenum format, type;  // glTexImage2D()'s
+	GLint filter, wrap;
+	EGLSyncKHR fence;  // texloader.c's
+};
+bool texLoaderStart(void);
+void texLoaderStop(void);
+void texLoaderSubmit(struct texLoad *const);
+bool texLoaderDone(struct texLoad *const, const bool);
+
+extern const struct quadRenderer gSoftRenderer;  // softrender.c
+extern const struct quadRenderer gGL33Renderer;  // gl33render.c
+#endif
 
 #endif
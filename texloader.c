@@ -0,0 +1,170 @@
+// texloader.c
+
+// Uploading textures on a thread of its own, so that a level's background does
+// not stall the frames drawn meanwhile. The thread has a second EGL context in
+// the render context's share group, with no surface. After each upload it
+// makes an EGL_KHR_fence_sync fence, which the render thread polls instead of
+// blocking on. See README-dev.md.
+
+#include "stlplayer.h"
+
+static struct {
+	EGLDisplay d;
+	EGLContext cxt;
+	PFNEGLCREATESYNCKHRPROC createSync;
+	PFNEGLCLIENTWAITSYNCKHRPROC clientWaitSync;
+	PFNEGLDESTROYSYNCKHRPROC destroySync;
+	thrd_t thr;
+	mtx_t mtx;
+	cnd_t cnd;  // a job was queued, a fence was made, or quit was set
+	struct texLoad *job;  // guarded by mtx; the next to upload
+	bool quit;  // guarded by mtx
+	bool running;
+} gLoader;
+
+// Upload one job's texels and fence the upload.
+static void uploadJob(struct texLoad *const job) {
+	glBindTexture(GL_TEXTURE_2D, job->texnam);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, job->filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, job->filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, job->wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, job->wrap);
+	glTexImage2D(GL_TEXTURE_2D, 0, job->format, job->width, job->height, 0,
+		job->format, job->type, job->texels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	must(glGetError() == GL_NO_ERROR);
+
+	const EGLSyncKHR fence = gLoader.createSync(gLoader.d, EGL_SYNC_FENCE_KHR,
+		NULL);
+	must(fence != EGL_NO_SYNC_KHR);
+	glFlush();  // so the fence can signal without this thread's help
+
+	mutexLock(&gLoader.mtx);
+	job->fence = fence;
+	cnd_broadcast(&gLoader.cnd);
+	mutexUnlock(&gLoader.mtx);
+}
+
+// The loader thread. Upload jobs until texLoaderStop().
+static int runLoader(void *p) {
+	assert(!p);
+	must(eglMakeCurrent(gLoader.d, EGL_NO_SURFACE, EGL_NO_SURFACE,
+		gLoader.cxt));
+	for (;;) {
+		mutexLock(&gLoader.mtx);
+		while (!gLoader.job && !gLoader.quit)
+			cnd_wait(&gLoader.cnd, &gLoader.mtx);
+		struct texLoad *const job = gLoader.job;
+		gLoader.job = NULL;
+		const bool quit = gLoader.quit;
+		mutexUnlock(&gLoader.mtx);
+		if (quit)
+			break;
+		uploadJob(job);
+	}
+	eglMakeCurrent(gLoader.d, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglReleaseThread();
+	return 0;
+}
+
+// Start the loader thread, with a context sharing the current one's objects.
+// Return false (and upload nothing) if EGL cannot do it, or if
+// STL_PLAYER_TEX_LOADER=0.
+bool texLoaderStart(void) {
+	assert(!gLoader.running);
+	const char *const env = getenv("STL_PLAYER_TEX_LOADER");
+	if (env && !atoi(env)) {
+		fprintf(stderr, "DEBUG: texture loader thread disabled\n");
+		return false;
+	}
+	gLoader.d = eglGetCurrentDisplay();
+	const EGLContext share = eglGetCurrentContext();
+	if (gLoader.d == EGL_NO_DISPLAY || share == EGL_NO_CONTEXT)
+		return false;
+	const char *const exts = eglQueryString(gLoader.d, EGL_EXTENSIONS);
+	if (!exts || !strstr(exts, "EGL_KHR_fence_sync") ||
+		!strstr(exts, "EGL_KHR_surfaceless_context")) {
+		fprintf(stderr, "DEBUG: no EGL_KHR_fence_sync or "
+			"EGL_KHR_surfaceless_context, so no texture loader thread\n");
+		return false;
+	}
+	gLoader.createSync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress(
+		"eglCreateSyncKHR");
+	gLoader.clientWaitSync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress(
+		"eglClientWaitSyncKHR");
+	gLoader.destroySync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress(
+		"eglDestroySyncKHR");
+	if (!gLoader.createSync || !gLoader.clientWaitSync || !gLoader.destroySync)
+		return false;
+
+	// the share group needs the same config (and client version)
+	EGLint configID, n;
+	EGLConfig cfg;
+	must(eglQueryContext(gLoader.d, share, EGL_CONFIG_ID, &configID));
+	const EGLint configAttribs[] = { EGL_CONFIG_ID, configID, EGL_NONE };
+	must(eglChooseConfig(gLoader.d, configAttribs, &cfg, 1, &n) && n == 1);
+	const EGLint attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+	gLoader.cxt = eglCreateContext(gLoader.d, cfg, share, attribs);
+	if (gLoader.cxt == EGL_NO_CONTEXT) {
+		fprintf(stderr, "DEBUG: no shared context, so no texture loader "
+			"thread\n");
+		return false;
+	}
+
+	must(thrd_success == mtx_init(&gLoader.mtx, mtx_plain));
+	must(thrd_success == cnd_init(&gLoader.cnd));
+	gLoader.job = NULL;
+	gLoader.quit = false;
+	must(thrd_success == thrd_create(&gLoader.thr, runLoader, NULL));
+	gLoader.running = true;
+	fprintf(stderr, "DEBUG: uploading level textures on a loader thread\n");
+	return true;
+}
+
+// Stop the loader thread, once the jobs it was given are done.
+void texLoaderStop(void) {
+	if (!gLoader.running)
+		return;
+	mutexLock(&gLoader.mtx);
+	gLoader.quit = true;
+	cnd_broadcast(&gLoader.cnd);
+	mutexUnlock(&gLoader.mtx);
+	must(thrd_success == thrd_join(gLoader.thr, NULL));
+	eglDestroyContext(gLoader.d, gLoader.cxt);
+	cnd_destroy(&gLoader.cnd);
+	mtx_destroy(&gLoader.mtx);
+	gLoader.running = false;
+}
+
+// Have the loader thread upload job. job and its texels must stay put until
+// texLoaderDone() returns true for it, and only one job can be in flight.
+void texLoaderSubmit(struct texLoad *const job) {
+	assert(gLoader.running);
+	job->fence = EGL_NO_SYNC_KHR;
+	mutexLock(&gLoader.mtx);
+	assert(!gLoader.job);
+	gLoader.job = job;
+	cnd_signal(&gLoader.cnd);
+	mutexUnlock(&gLoader.mtx);
+}
+
+// Return whether job's upload is done, so that the calling context can draw
+// with its texture (after binding it again). If block, wait until it is.
+bool texLoaderDone(struct texLoad *const job, const bool block) {
+	mutexLock(&gLoader.mtx);
+	while (block && job->fence == EGL_NO_SYNC_KHR)
+		cnd_wait(&gLoader.cnd, &gLoader.mtx);
+	const EGLSyncKHR fence = job->fence;
+	mutexUnlock(&gLoader.mtx);
+	if (fence == EGL_NO_SYNC_KHR)
+		return false;
+
+	const EGLint status = gLoader.clientWaitSync(gLoader.d, fence, 0,
+		block ? EGL_FOREVER_KHR : 0);
+	if (status == EGL_TIMEOUT_EXPIRED_KHR)
+		return false;
+	must(status == EGL_CONDITION_SATISFIED_KHR);
+	gLoader.destroySync(gLoader.d, fence);
+	job->fence = EGL_NO_SYNC_KHR;
+	return true;
+}
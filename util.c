@@ -1,7 +1,17 @@
 // util.c
 
+#define _GNU_SOURCE  // pread(), syscall(), posix_fadvise(), clock_nanosleep()
+
 #include "util.h"
 
+#include <errno.h>
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
 char gSelf[4096];
 int gSelf_len;
 
@@ -15,15 +25,19 @@ char *safe_read_fail(char *buf, ssize_t *has_read, int fd) {
 	return NULL;
 }
 
-char *safe_read(const char *const filename, ssize_t *has_read) {
+// Read all of fd into a heap buffer, then close fd.
+char *safe_read_fd(const int fd, ssize_t *has_read) {
 	*has_read = 0;
-
-	int fd = open(filename, O_RDONLY);
-	if (fd < 0)
-		return NULL;
 	
-	char *buf = malloc(1);
+	// Start with room for the whole file (plus the 0-byte read at EOF), so
+	// regular files need no reallocs. Files without a size start out small.
+	struct stat st;
 	ssize_t bufsiz = 1;
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size < SSIZE_MAX / 2)
+		bufsiz = st.st_size + 1;
+	char *buf = malloc(bufsiz);
+	if (!buf)
+		return safe_read_fail(buf, has_read, fd);
 	
 	for (;;) {
 		if (*has_read > SSIZE_MAX - (ssize_t)buf) {
@@ -59,6 +73,416 @@ char *safe_read(const char *const filename, ssize_t *has_read) {
 	return NULL;
 }
 
+char *safe_read(const char *const filename, ssize_t *has_read) {
+	*has_read = 0;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	return safe_read_fd(fd, has_read);
+}
+
+#define VFS_MAX_DIRS 8
+#ifndef MACOSX
+static int gVfsDirs[VFS_MAX_DIRS];  // the overlays first, then the stock data
+static size_t gVfsDirs_len;
+
+// Helper for vfsInit.
+static void vfsAddDir(const char *const dir) {
+	if (gVfsDirs_len == VFS_MAX_DIRS) {
+		fprintf(stderr, "WARN: too many data dirs, ignoring %s\n", dir);
+		return;
+	}
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "WARN: could not open data dir %s\n", dir);
+		return;
+	}
+	fprintf(stderr, "DEBUG: data dir %zu is %s\n", gVfsDirs_len, dir);
+	gVfsDirs[gVfsDirs_len++] = fd;
+}
+#endif
+
+// Open the data directories once: the overlays listed in $STL_PLAYER_OVERLAYS
+// (colon-separated, highest priority first), then the executable's directory.
+// Must run after gSelf is populated, and before any thread calls vfsOpen().
+void vfsInit(void) {
+	assert(gSelf_len > 0);
+#ifndef MACOSX
+	assert(gVfsDirs_len == 0);
+	const char *const overlays = getenv("STL_PLAYER_OVERLAYS");
+	if (overlays) {
+		char *const dirs = nnmalloc(strlen(overlays) + 1);
+		strcpy(dirs, overlays);
+		char *saveptr;
+		for (char *dir = strtok_r(dirs, ":", &saveptr); dir;
+			dir = strtok_r(NULL, ":", &saveptr))
+			vfsAddDir(dir);
+		free(dirs);
+	}
+	vfsAddDir(gSelf);
+	must(gVfsDirs_len > 0);
+#endif
+}
+
+// Open the asset rel (a path relative to the data directories) read-only.
+// Returns an fd from the first data directory that has rel, or -1. Does not
+// touch gSelf, so it is safe to call from any thread.
+int vfsOpen(const char *const rel) {
+#ifndef MACOSX
+	for (size_t i = 0; i < gVfsDirs_len; i++) {
+		const int fd = openat(gVfsDirs[i], rel, O_RDONLY | O_CLOEXEC);
+		if (fd >= 0)
+			return fd;
+	}
+	return -1;
+#else
+	char path[4096];
+	if (gSelf_len + strlen(rel) >= sizeof(path))
+		return -1;
+	memcpy(path, gSelf, gSelf_len);
+	strcpy(path + gSelf_len, rel);
+	return open(path, O_RDONLY);
+#endif
+}
+
+// safe_read() for an asset. See vfsOpen().
+char *vfsRead(const char *const rel, ssize_t *has_read) {
+	*has_read = 0;
+	
+	const int fd = vfsOpen(rel);
+	if (fd < 0)
+		return NULL;
+	return safe_read_fd(fd, has_read);
+}
+
+// Fill in path with the name of a file in the per-user cache directory
+// ($XDG_CACHE_HOME/stl_player, or ~/.cache/stl_player), creating the directory
+// if needed. Return false if there is no such directory.
+bool cachePath(char *const path, const size_t size, const char *const name) {
+	const char *const xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	int len;
+	if (xdg && *xdg)
+		len = snprintf(path, size, "%s/stl_player", xdg);
+	else if (home && *home) {
+		len = snprintf(path, size, "%s/.cache", home);
+		if (len > 0 && (size_t)len < size)
+			mkdir(path, 0755);
+		len = snprintf(path, size, "%s/.cache/stl_player", home);
+	} else
+		return false;
+	if (len < 0 || (size_t)len >= size)
+		return false;
+	if (mkdir(path, 0755) != 0 && errno != EEXIST)
+		return false;
+	const int nameLen = snprintf(path + len, size - len, "/%s", name);
+	return nameLen > 0 && (size_t)(len + nameLen) < size;
+}
+
+// Write len bytes to path, through a temporary file so that readers never
+// see half of it.
+bool writeFileAtomically(const char *const path, const void *const data,
+	const size_t len) {
+	char tmp[4096];
+	const int n = snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	if (n < 0 || (size_t)n >= sizeof(tmp))
+		return false;
+	FILE *const f = fopen(tmp, "wb");
+	if (!f)
+		return false;
+	const bool ok = fwrite(data, 1, len, f) == len;
+	if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+		remove(tmp);
+		return false;
+	}
+	return true;
+}
+
+// Helper for readAssets. Mark an asset as failed, like safe_read() would.
+static void assetFail(asset *const a) {
+	a->buf = NULL;
+	a->len = 0;
+}
+
+// Helper for readAssets. Open every asset and size one arena from the fstat()
+// results, so that every read goes straight into its final place. fds[i] is -1
+// for assets that could not be opened.
+static char *openAssets(asset *const assets, const size_t n, int *const fds,
+	size_t *const arena_len) {
+	size_t *const offsets = nnmalloc(n * sizeof(size_t));
+	*arena_len = 0;
+	for (size_t i = 0; i < n; i++) {
+		assetFail(&assets[i]);
+		fds[i] = -1;
+		
+		const int fd = vfsOpen(assets[i].path);
+		if (fd < 0)
+			continue;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < 0 ||
+			(size_t)st.st_size > SIZE_MAX / 2 - *arena_len) {
+			assert(close(fd) == 0);
+			continue;
+		}
+		fds[i] = fd;
+		offsets[i] = *arena_len;
+		assets[i].len = st.st_size;
+		*arena_len += (st.st_size + 15) & ~(size_t)15;  // keep slices aligned
+	}
+	
+	char *const arena = nnmalloc(*arena_len > 0 ? *arena_len : 1);
+	for (size_t i = 0; i < n; i++)
+		if (fds[i] >= 0)
+			assets[i].buf = arena + offsets[i];
+	free(offsets);
+	return arena;
+}
+
+// Read the rest of an opened asset with pread(), starting done bytes in.
+static bool preadAsset(asset *const a, const int fd, ssize_t done) {
+	while (done < a->len) {
+		const ssize_t got = pread(fd, a->buf + done, a->len - done, done);
+		if (got <= 0)  // error, or the file shrank since fstat()
+			return false;
+		done += got;
+	}
+	return true;
+}
+
+// Helper for readAssets. Portable fallback backend.
+static void readAssetsPread(asset *const assets, const size_t n,
+	const int *const fds) {
+	for (size_t i = 0; i < n; i++)
+		if (fds[i] >= 0 && !preadAsset(&assets[i], fds[i], 0))
+			assetFail(&assets[i]);
+}
+
+#ifdef USE_IO_URING
+struct uring {
+	int fd;
+	unsigned entries;
+	unsigned *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqRing, *cqRing;
+	size_t sqRing_len, cqRing_len, sqes_len;
+};
+
+// Tear down a ring set up by uringInit().
+static void uringFree(struct uring *const r) {
+	if (r->sqes && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_len);
+	if (r->cqRing && r->cqRing != MAP_FAILED && r->cqRing != r->sqRing)
+		munmap(r->cqRing, r->cqRing_len);
+	if (r->sqRing && r->sqRing != MAP_FAILED)
+		munmap(r->sqRing, r->sqRing_len);
+	assert(close(r->fd) == 0);
+}
+
+// Set up an io_uring with raw syscalls (there is no liburing dependency).
+// Returns false if the kernel does not support io_uring or has it disabled.
+static bool uringInit(struct uring *const r, const unsigned entries) {
+	memset(r, 0, sizeof(*r));
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return false;
+	
+	r->entries = p.sq_entries;
+	r->sqRing_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cqRing_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	const bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap && r->cqRing_len > r->sqRing_len)
+		r->sqRing_len = r->cqRing_len;
+	
+	r->sqRing = mmap(NULL, r->sqRing_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		r->fd, IORING_OFF_SQ_RING);
+	if (singleMmap)
+		r->cqRing = r->sqRing;
+	else
+		r->cqRing = mmap(NULL, r->cqRing_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED, r->fd, IORING_OFF_CQ_RING);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		r->fd, IORING_OFF_SQES);
+	if (r->sqRing == MAP_FAILED || r->cqRing == MAP_FAILED ||
+		r->sqes == MAP_FAILED) {
+		uringFree(r);
+		return false;
+	}
+	
+	char *const sq = r->sqRing, *const cq = r->cqRing;
+	r->sqTail = (unsigned *)(sq + p.sq_off.tail);
+	r->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sqArray = (unsigned *)(sq + p.sq_off.array);
+	r->cqHead = (unsigned *)(cq + p.cq_off.head);
+	r->cqTail = (unsigned *)(cq + p.cq_off.tail);
+	r->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return true;
+}
+
+// Helper for readAssetsUring. Queue reads starting at assets[*next] until the
+// submission queue is full. Returns the number of reads queued.
+static unsigned uringQueueReads(struct uring *const r, asset *const assets,
+	const size_t n, const int *const fds, size_t *const next,
+	const bool fixed) {
+	unsigned tail = *r->sqTail;  // only this thread writes the tail
+	unsigned queued = 0;
+	for (; *next < n && queued < r->entries; (*next)++) {
+		const size_t i = *next;
+		if (fds[i] < 0 || assets[i].len == 0)
+			continue;
+		assert(assets[i].len <= UINT32_MAX);
+		const unsigned idx = tail & *r->sqMask;
+		struct io_uring_sqe *const sqe = &r->sqes[idx];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = fds[i];
+		sqe->addr = (uintptr_t)assets[i].buf;
+		sqe->len = assets[i].len;
+		sqe->off = 0;
+		sqe->buf_index = 0;  // the whole arena is registered buffer #0
+		sqe->user_data = i;
+		r->sqArray[idx] = idx;
+		tail++;
+		queued++;
+	}
+	__atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+	return queued;
+}
+
+// Helper for readAssets. Submit the reads in as few io_uring_enter() calls as
+// the ring size allows. The arena is registered as a fixed buffer when the
+// memlock limit permits it. Returns false (having read nothing) if io_uring
+// is unavailable.
+static bool readAssetsUring(asset *const assets, const size_t n,
+	const int *const fds, char *const arena, const size_t arena_len) {
+	struct uring r;
+	if (!uringInit(&r, 128))
+		return false;
+	
+	struct iovec iov = { .iov_base = arena, .iov_len = arena_len };
+	const bool fixed = arena_len > 0 &&
+		0 == syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+		&iov, 1);
+	
+	size_t next = 0;
+	while (next < n) {
+		const unsigned queued = uringQueueReads(&r, assets, n, fds, &next,
+			fixed);
+		unsigned submitted = 0, completed = 0;
+		while (completed < queued) {
+			const long ret = syscall(__NR_io_uring_enter, r.fd,
+				queued - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+			must(ret >= 0 || errno == EINTR || errno == EAGAIN);
+			if (ret > 0)
+				submitted += ret;
+			
+			unsigned head = *r.cqHead;
+			const unsigned tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++, completed++) {
+				const struct io_uring_cqe *const cqe =
+					&r.cqes[head & *r.cqMask];
+				const size_t i = cqe->user_data;
+				// finish short reads, and redo failed ones (e.g. -EINVAL from
+				// kernels before 5.6, which have no IORING_OP_READ) with pread
+				if (!preadAsset(&assets[i], fds[i], cqe->res > 0 ? cqe->res : 0))
+					assetFail(&assets[i]);
+			}
+			__atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+		}
+	}
+	
+	uringFree(&r);
+	return true;
+}
+#endif
+
+// Read a batch of assets, e.g. every texture needed at startup. All of the
+// buffers live in the returned arena, which the caller must free() once it is
+// done with every assets[i].buf. Failed assets have buf = NULL and len = 0.
+char *readAssets(asset *const assets, const size_t n,
+	const enum assetBackend backend) {
+	int *const fds = nnmalloc((n > 0 ? n : 1) * sizeof(int));
+	size_t arena_len;
+	char *const arena = openAssets(assets, n, fds, &arena_len);
+	
+	bool done = false;
+#ifdef USE_IO_URING
+	if (backend != ASSET_IO_PREAD)
+		done = readAssetsUring(assets, n, fds, arena, arena_len);
+#endif
+	if (!done && backend == ASSET_IO_URING)
+		fprintf(stderr, "WARN: io_uring unavailable, falling back to pread\n");
+	if (!done)
+		readAssetsPread(assets, n, fds);
+	
+	for (size_t i = 0; i < n; i++)
+		if (fds[i] >= 0)
+			assert(close(fds[i]) == 0);
+	free(fds);
+	return arena;
+}
+
+// Helper for benchAssetIO. Evict the assets from the page cache.
+static void dropAssetsFromCache(const asset *const assets, const size_t n) {
+#ifndef MACOSX
+	for (size_t i = 0; i < n; i++) {
+		const int fd = vfsOpen(assets[i].path);
+		if (fd < 0)
+			continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		assert(close(fd) == 0);
+	}
+#else
+	assert(assets || n == 0);
+#endif
+}
+
+// Helper for benchAssetIO. Read the assets one file at a time with safe_read().
+static void readAssetsOneByOne(const asset *const assets, const size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		ssize_t has_read;
+		free(vfsRead(assets[i].path, &has_read));
+	}
+}
+
+// Time safe_read() against each readAssets() backend, on a warm and a cold
+// page cache. (The cold runs rely on POSIX_FADV_DONTNEED, so they are only
+// as cold as the kernel is willing to make them.)
+void benchAssetIO(asset *const assets, const size_t n) {
+	const char *const names[] = { "safe_read", "pread", "io_uring" };
+	const int kIterations = 20;
+	
+	for (int cold = 0; cold <= 1; cold++)
+		for (int backend = 0; backend < 3; backend++) {
+			struct timespec then, now;
+			double total_ms = 0, worst_ms = 0;
+			for (int iter = 0; iter < kIterations; iter++) {
+				if (cold)
+					dropAssetsFromCache(assets, n);
+				assert(TIME_UTC == timespec_get(&then, TIME_UTC));
+				if (backend == 0)
+					readAssetsOneByOne(assets, n);
+				else
+					free(readAssets(assets, n,
+						backend == 1 ? ASSET_IO_PREAD : ASSET_IO_URING));
+				assert(TIME_UTC == timespec_get(&now, TIME_UTC));
+				const double ms = (now.tv_sec - then.tv_sec) * 1000.0 +
+					(now.tv_nsec - then.tv_nsec) / 1000000.0;
+				total_ms += ms;
+				if (ms > worst_ms)
+					worst_ms = ms;
+			}
+			fprintf(stderr, "BENCH: %zu assets, %s cache, %-9s: "
+				"avg %.3f ms, worst %.3f ms\n", n, cold ? "cold" : "warm",
+				names[backend], total_ms / kIterations, worst_ms);
+		}
+}
+
 bool elapsedTimeGreaterThanNS(struct timespec *const prev,
 	struct timespec *const now, int64_t ns) {
 	if (now->tv_sec - prev->tv_sec != 0)
@@ -176,6 +600,17 @@ void findSelfOnLinux(void) {
 	fprintf(stderr, "DEBUG: path w/out filename: %s\n", gSelf);
 }
 
+static int64_t clockNS(const clockid_t clk) {
+	struct timespec ts;
+	must(0 == clock_gettime(clk, &ts));
+	return ts.tv_sec * (int64_t)NSONE + ts.tv_nsec;
+}
+
+// Nanoseconds on a clock that never jumps (unlike TIME_UTC).
+int64_t monotonicNS(void) {
+	return clockNS(CLOCK_MONOTONIC);
+}
+
 #ifndef MACOSX
 // Lock a mutex. Always succeeds.
 void mutexLock(mtx_t *const mtx) {
@@ -188,4 +623,21 @@ void mutexUnlock(mtx_t *const mtx) {
 	int ret = mtx_unlock(mtx);
 	must(ret == thrd_success);
 }
+
+// CPU time used by the whole process, in nanoseconds.
+int64_t processCPUNS(void) {
+	return clockNS(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+// CPU time used by the calling thread, in nanoseconds.
+int64_t threadCPUNS(void) {
+	return clockNS(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// Sleep until monotonicNS() reaches deadline. Returns at once if it has.
+void sleepUntilNS(const int64_t deadline) {
+	const struct timespec ts = { deadline / NSONE, deadline % NSONE };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
 #endif
@@ -83,18 +83,44 @@ struct level {
 };
 typedef struct level stl;
 
+struct asset {
+	const char *path;  // relative to the executable's directory
+	char *buf;  // points into the arena returned by readAssets(); NULL on error
+	ssize_t len;
+};
+typedef struct asset asset;
+
+enum assetBackend {
+	ASSET_IO_DEFAULT,  // io_uring if compiled in and usable, else pread
+	ASSET_IO_PREAD,
+	ASSET_IO_URING,
+};
+
 void *nnmalloc(size_t);
 
+char *safe_read_fd(const int fd, ssize_t *has_read);
 char *safe_read(const char *const filename, ssize_t *has_read);
+void vfsInit(void);
+int vfsOpen(const char *const rel);
+char *vfsRead(const char *const rel, ssize_t *has_read);
+bool cachePath(char *const path, const size_t size, const char *const name);
+bool writeFileAtomically(const char *const path, const void *const data,
+	const size_t len);
+char *readAssets(asset *const assets, const size_t n, const enum assetBackend);
+void benchAssetIO(asset *const assets, const size_t n);
 bool isWhitespace(char ch);
 void trimWhitespace(const char **section, size_t *section_len);
 int intAsStrLen(int n);
 void printTM(uint8_t **const tm, const int width, const int height);
 void must(unsigned long long condition);
 void findSelfOnLinux(void);
+int64_t monotonicNS(void);
 #if (!defined(MACOSX))  // i.e., is Linux
 void mutexLock(mtx_t *const mtx);
 void mutexUnlock(mtx_t *const mtx);
+int64_t processCPUNS(void);
+int64_t threadCPUNS(void);
+void sleepUntilNS(const int64_t deadline);
 #endif
 #if defined(MACOSX)
 void findSelfOnMac(void);